@@ -31,12 +31,45 @@ MAK_LIBS=$(LIB_PREFIX)$(MEN_LIB_DIR)/mdis_api$(LIB_SUFFIX)	\
          $(LIB_PREFIX)$(MEN_LIB_DIR)/usr_oss$(LIB_SUFFIX)	\
          $(LIB_PREFIX)$(MEN_LIB_DIR)/usr_utl$(LIB_SUFFIX)	\
 
+# Linux only (MDIS for Linux build, like the LINUX switch in the sources):
+# threads (-S, -f, -G, -C), clock_gettime() on glibc < 2.34
+ifneq ($(MEN_LIN_DIR),)
+MAK_LIBS+=-lpthread -lrt
+endif
+
 MAK_INCL=$(MEN_INC_DIR)/wdog.h		\
          $(MEN_INC_DIR)/men_typs.h	\
          $(MEN_INC_DIR)/mdis_api.h	\
          $(MEN_INC_DIR)/usr_oss.h	\
          $(MEN_INC_DIR)/usr_utl.h	\
+         $(MEN_MOD_DIR)/wdog_ctrl_int.h	\
 
 MAK_INP1=wdog_ctrl$(INP_SUFFIX)
+MAK_INP2=wdog_ctrl_evt$(INP_SUFFIX)
+MAK_INP3=wdog_ctrl_snap$(INP_SUFFIX)
+MAK_INP4=wdog_ctrl_fault$(INP_SUFFIX)
+MAK_INP5=wdog_ctrl_stat$(INP_SUFFIX)
+MAK_INP6=wdog_ctrl_meas$(INP_SUFFIX)
+MAK_INP7=wdog_ctrl_sched$(INP_SUFFIX)
+MAK_INP8=wdog_ctrl_ho$(INP_SUFFIX)
+MAK_INP9=wdog_ctrl_perf$(INP_SUFFIX)
+MAK_INP10=wdog_ctrl_rec$(INP_SUFFIX)
+MAK_INP11=wdog_ctrl_gate$(INP_SUFFIX)
+MAK_INP12=wdog_ctrl_auto$(INP_SUFFIX)
+MAK_INP13=wdog_ctrl_cap$(INP_SUFFIX)
+MAK_INP14=wdog_ctrl_ctl$(INP_SUFFIX)
 
-MAK_INP=$(MAK_INP1)
+MAK_INP=$(MAK_INP1) \
+        $(MAK_INP2) \
+        $(MAK_INP3) \
+        $(MAK_INP4) \
+        $(MAK_INP5) \
+        $(MAK_INP6) \
+        $(MAK_INP7) \
+        $(MAK_INP8) \
+        $(MAK_INP9) \
+        $(MAK_INP10) \
+        $(MAK_INP11) \
+        $(MAK_INP12) \
+        $(MAK_INP13) \
+        $(MAK_INP14)
@@ -24,7 +24,7 @@
  *       \brief  Control tool for WDOG profile drivers (e.g. Z47)
  *
  *     Required: libraries: mdis_api, usr_oss, usr_utl
- *    \switches  (none)
+ *    \switches  LINUX - event loop based on timerfd/signalfd/epoll
  */
  /*
  *---------------------------------------------------------------------------
@@ -37,37 +37,56 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <signal.h>
+#ifdef LINUX
+#	include <unistd.h>
+#endif
 #include <MEN/men_typs.h>
 #include <MEN/mdis_api.h>
 #include <MEN/usr_oss.h>
 #include <MEN/usr_utl.h>
 #include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
 
 static const char IdentString[]=MENT_XSTR(MAK_REVISION);
 
-/*--------------------------------------+
-|   DEFINES                             |
-+--------------------------------------*/
-#define ERR_OK		0
-#define ERR_PARAM	1
-#define ERR_FUNC	2
-
-#define PRINT_ERR	printf("*** error: %s\n", M_errstring(UOS_ErrnoGet()));
-
 /*--------------------------------------+
 |   GLOBALS                             |
 +--------------------------------------*/
-static MDIS_PATH G_path;
+MDIS_PATH G_path;
 static u_int32 G_sigCount = 0;
 static int32 G_rst;
+static WDOG_REC *G_rec;		/* flight recorder for irq signals */
+static WDOG_EVT *G_irqEvt;		/* -Q: event loop woken by irq signal */
+static volatile u_int64 G_irqAt;	/* -Q: time of last irq signal [us] */
+static volatile sig_atomic_t G_irqSeq;	/* -Q: incremented after G_irqAt */
+
+/** status codes read by GetInfo() */
+const WDOG_CODE G_wdogCode[WDOG_CODES] = {
+	{ WDOG_TIME,		"WDOG_TIME"		  },
+	{ WDOG_STATUS,		"WDOG_STATUS"	  },
+	{ WDOG_SHOT,		"WDOG_SHOT"		  },
+	{ WDOG_TRIG_PAT,	"WDOG_TRIG_PAT"	  },
+	{ WDOG_TIME_MIN,	"WDOG_TIME_MIN"	  },
+	{ WDOG_TIME_MAX,	"WDOG_TIME_MAX"	  },
+	{ WDOG_TIME_IRQ,	"WDOG_TIME_IRQ"	  },
+	{ WDOG_OUT_PIN,		"WDOG_OUT_PIN"	  },
+	{ WDOG_OUT_REASON,	"WDOG_OUT_REASON" },
+	{ WDOG_IRQ_PIN,		"WDOG_IRQ_PIN"	  },
+	{ WDOG_IRQ_REASON,	"WDOG_IRQ_REASON" },
+	{ WDOG_ERR_PIN,		"WDOG_ERR_PIN"	  },
+};
 
 /*--------------------------------------+
 |  PROTOTYPES                           |
 +--------------------------------------*/
 static void usage(void);
-static int PrintError(char *info);
-static int GetInfo( void );
+static int Calibrate(int32 trigT, u_int32 *spin);
+static int TriggerLoop(WDOG_LOOP *lp);
+static int LoopRun(WDOG_LOOP *lp, const char *device, const char *perfFile,
+				   const char *recFile, const char *gateFile, const char *ctlPath);
 static void __MAPILIB SignalHandler( u_int32 sig );
+static u_int64 IrqAt(void);
 
 /********************************* usage ***********************************/
 /**  Print program usage
@@ -75,12 +94,17 @@ static void __MAPILIB SignalHandler( u_int32 sig );
 static void usage(void)
 {
 	printf("Usage:    wdog_ctrl <device> <opts> [<opts>]                         \n");
+	printf("          wdog_ctrl -S [-J=<n>] <device> [<device> ...]              \n");
 	printf("Function: Control tool for WDOG profile drivers (e.g. Z47)           \n");
 	printf("Options:                                                [default]    \n");
 	printf("    device     device name (e.g. wdog_1)                             \n");
 	printf("    -g         get watchdog info                                     \n");
 	printf("    -r         reset wdog (counter, output/irq pin)                  \n");
 	printf("    -c         clear reason of last output/irq pin assertion         \n");
+	printf("    -k         probe supported codes, setstat and time ranges again  \n");
+	printf("                 and print them (wdog stopped!), the result is cached\n");
+	printf("                 per device and driver revision in                   \n");
+	printf("                 /var/cache/wdog_ctrl/wdog_ctrl.cap                  \n");
 	printf("               -------------- Time Setting -------------------       \n");
 	printf("    -u=<ms>    set wdog max/upper time [ms]                          \n");
 	printf("                 0 disables the upper limit                          \n");
@@ -94,11 +118,60 @@ static void usage(void)
 	printf("    -e=<0,1>   0=clear, 1=set error pin                              \n");
 	printf("               -------------- Loop Operations -------------------    \n");
 	printf("    -T=<ms>    start wdog, trigger all <ms> until keypress, stop wdog\n");
+	printf("                 (SIGTERM/SIGINT also stop the wdog)                 \n");
 	printf("    -P=<ms>    same as -T but trigger with alternating pattern       \n");
 	printf("    -I=<ms>    increment trigger time at each loop pass [0]          \n");
 	printf("    -R=<ms>    reset wdog at irq signal after <ms>                   \n");
 	printf("    -A=<n>     abort after n passes                                  \n");
 	printf("    -V         verbose output                                        \n");
+	printf("    -Q         irq driven: trigger at each irq signal (-q), the -T/-P\n");
+	printf("                 time is only the fallback if no irq arrives, print  \n");
+	printf("                 irq to trigger latency and fallback activations     \n");
+	printf("    -a=<pct>   auto period for -T/-P (start value): longest period  \n");
+	printf("                 that keeps <pct>%% of the max. time as margin over \n");
+	printf("                 the p99.99 trigger latency, each change is logged   \n");
+	printf("    -H=<sock>  handover socket: a new instance with the same socket  \n");
+	printf("                 takes over the running -T/-P loop without stop and  \n");
+	printf("                 reopen, the old instance exits without WDOG_STOP    \n");
+	printf("                 (mode 0600, directory not writable for others, /run)\n");
+	printf("    -C=<sock>  control socket for -T/-P: change times, period, pattern\n");
+	printf("                 mode, verbosity or read info while the loop runs,   \n");
+	printf("                 see wdog_ctrl_ctl.c for the commands                \n");
+	printf("    -p         precision mode for -T/-P: sleep until shortly before  \n");
+	printf("                 the deadline, spin for the rest (calibrated), print \n");
+	printf("                 deadline error and spin time at the end             \n");
+	printf("    -K=<file>  perf counters (cycles, instructions, context switches,\n");
+	printf("                 faults, migrations) around wait and trigger of each \n");
+	printf("                 pass, one record per pass in <file>, slow passes    \n");
+	printf("                 attributed to a cause (Linux)                       \n");
+	printf("    -f=<file>  flight recorder: record triggers, intervals, margins, \n");
+	printf("                 errors and irq signals of -T/-P to a mapped ring in \n");
+	printf("                 <file>, synced each second, old one kept as .old    \n");
+	printf("    -F=<file>  decode flight recording and correlate it with the     \n");
+	printf("                 WDOG_SHOT/WDOG_OUT_REASON of the device (-V: all)   \n");
+	printf("    -G=<file>  health gate: stop triggering while PSI pressure or    \n");
+	printf("                 liveness probes (file mtime, pid state) stay bad for\n");
+	printf("                 the hold time, see wdog_ctrl_gate.c for the syntax  \n");
+	printf("               -------------- Schedule --------------------------    \n");
+	printf("    -s=<file>  compile schedule script (times, triggers, ramps, pins,\n");
+	printf("                 expectations, repeats), then run it in one pass     \n");
+	printf("                 see wdog_ctrl_sched.c for the syntax                \n");
+	printf("               -------------- Timeout Measurement ---------------    \n");
+	printf("    -M=<n>     measure real timeout n times: trigger once, poll out/ \n");
+	printf("                 irq pin until asserted, reset wdog, print statistics\n");
+	printf("               !!! ONLY FOR BOARDS WHERE OUT PIN DOESN'T RESET   !!! \n");
+	printf("               -------------- Fault Injection -------------------    \n");
+	printf("    -x=<seed>  inject random faults into -T/-P loop (delay, skip,    \n");
+	printf("                 burst, wrong pattern), log reasons read back        \n");
+	printf("    -y=<pct>   probability of a random fault per pass [10]           \n");
+	printf("    -X=<file>  inject faults from script, lines: <pass> <fault> [<n>]\n");
+	printf("                 faults: delay <ms>, skip, badpat, burst <n>         \n");
+	printf("               !!! CAUTION: MAY RESET YOUR SYSTEM                !!! \n");
+	printf("               -------------- Snapshot -------------------------     \n");
+	printf("    -S         read info of all given devices in parallel and print  \n");
+	printf("                 it as JSON, a device may be a pattern, e.g. 'wdog_*'\n");
+	printf("                 (matched against wdog_1..wdog_32)                   \n");
+	printf("    -J=<n>     max. number of devices read in parallel for -S [8]    \n");
 	printf("\n");
 	printf("Copyright 2016-2019, MEN Mikro Elektronik GmbH\n%s\n", IdentString);
 }
@@ -114,10 +187,16 @@ static void usage(void)
 int main(int argc, char *argv[])
 {
 	char	*device, *str, *errstr, buf[40];
-	u_int32	count = 0;
 	int32	get, reset, clear, maxT, minT, irqT, outP, irqP, errP;
-	int32	trig, trigPat, trigT, incrT, pat, patIdx=0;
-	int32	abort, loop, loopcnt, verbose;
+	int32	trig, trigPat, trigT, incrT;
+	int32	abort, verbose, precise, fltPct, meas, irqDrive, autoPct;
+	char	*fltSeed, *fltScript, *sched, *hoPath, *perfFile;
+	char	*recFile, *gateFile, *ctlPath;
+	int32	reprobe;
+	WDOG_LOOP	loop;
+	WDOG_FAULT	flt;
+	WDOG_CAP	cap;
+	WDOG_SCHED	sc;
 	int		n;
 
 	int		ret=ERR_OK;
@@ -125,7 +204,7 @@ int main(int argc, char *argv[])
 	/*----------------------+
 	|  check arguments      |
 	+----------------------*/
-	if ((errstr = UTL_ILLIOPT("grcu=l=q=o=i=e=T=P=I=R=A=V?", buf))) {
+	if ((errstr = UTL_ILLIOPT("grcku=l=q=o=i=e=T=P=I=R=A=VpQa=H=C=K=f=F=G=x=y=X=M=s=SJ=?", buf))) {
 		printf("*** %s\n", errstr);
 		return ERR_PARAM;
 	}
@@ -138,6 +217,12 @@ int main(int argc, char *argv[])
 		return ERR_PARAM;
 	}
 
+	/*----------------------+
+	|  snapshot             |
+	+----------------------*/
+	if (UTL_TSTOPT("S"))
+		return Snapshot(argc, argv, (str = UTL_TSTOPT("J=")) ? atoi(str) : 8);
+
 	/*----------------------+
 	|  get arguments        |
 	+----------------------*/
@@ -155,6 +240,7 @@ int main(int argc, char *argv[])
 	get     = (UTL_TSTOPT("g") ? 1 : 0);
 	reset   = (UTL_TSTOPT("r") ? 1 : 0);
 	clear   = (UTL_TSTOPT("c") ? 1 : 0);
+	reprobe = (UTL_TSTOPT("k") ? 1 : 0);
 	maxT    = ((str = UTL_TSTOPT("u=")) ? atoi(str) : -1);
 	minT    = ((str = UTL_TSTOPT("l=")) ? atoi(str) : -1);
 	irqT    = ((str = UTL_TSTOPT("q=")) ? atoi(str) : -1);
@@ -167,6 +253,25 @@ int main(int argc, char *argv[])
 	G_rst   = ((str = UTL_TSTOPT("R=")) ? atoi(str) : -1);
 	abort   = ((str = UTL_TSTOPT("A=")) ? atoi(str) : -1);
 	verbose = (UTL_TSTOPT("V") ? 1 : 0);
+	precise = (UTL_TSTOPT("p") ? 1 : 0);
+	irqDrive = (UTL_TSTOPT("Q") ? 1 : 0);
+	autoPct = ((str = UTL_TSTOPT("a=")) ? atoi(str) : -1);
+	fltSeed   = UTL_TSTOPT("x=");
+	fltScript = UTL_TSTOPT("X=");
+	fltPct    = ((str = UTL_TSTOPT("y=")) ? atoi(str) : 10);
+	meas    = ((str = UTL_TSTOPT("M=")) ? atoi(str) : 0);
+	sched   = UTL_TSTOPT("s=");
+	hoPath  = UTL_TSTOPT("H=");
+	perfFile = UTL_TSTOPT("K=");
+	recFile = UTL_TSTOPT("f=");
+	gateFile = UTL_TSTOPT("G=");
+	ctlPath = UTL_TSTOPT("C=");
+
+	/*----------------------+
+	|  decode recording     |
+	+----------------------*/
+	if ((str = UTL_TSTOPT("F=")))
+		return RecDecode(str, device, verbose);
 
 	/* further parameter checking */
 	if ((trig != -1) && (trigPat != -1)) {
@@ -190,6 +295,108 @@ int main(int argc, char *argv[])
 		printf("*** -R requires -T/-P and -q>0\n");
 		return ERR_PARAM;
 	}
+	if (precise && (trigT == -1)) {
+		printf("*** -p requires -T/-P\n");
+		return ERR_PARAM;
+	}
+	if (meas && (trigT != -1)) {
+		printf("*** -M and -T/-P specified, this is not supported\n");
+		return ERR_PARAM;
+	}
+	if (sched && (meas || (trigT != -1))) {
+		printf("*** -s and -T/-P/-M specified, this is not supported\n");
+		return ERR_PARAM;
+	}
+	if (irqDrive && ((trigT == -1) || (irqT <= 0) || (irqT >= trigT))) {
+		printf("*** -Q requires -T/-P and 0 < -q < -T/-P\n");
+		return ERR_PARAM;
+	}
+	if (irqDrive && ((G_rst != -1) || incrT || precise || hoPath ||
+					 fltSeed || fltScript)) {
+		printf("*** -Q and -R/-I/-p/-H/-x/-X specified, this is not supported\n");
+		return ERR_PARAM;
+	}
+	if ((autoPct != -1) && ((trigT == -1) || (autoPct <= 0) || (autoPct >= 100))) {
+		printf("*** -a requires -T/-P and 0 < -a < 100\n");
+		return ERR_PARAM;
+	}
+	if ((autoPct != -1) && (incrT || irqDrive || fltSeed || fltScript)) {
+		printf("*** -a and -I/-Q/-x/-X specified, this is not supported\n");
+		return ERR_PARAM;
+	}
+	if (hoPath && (trigT == -1)) {
+		printf("*** -H requires -T/-P\n");
+		return ERR_PARAM;
+	}
+	if (ctlPath && (trigT == -1)) {
+		printf("*** -C requires -T/-P\n");
+		return ERR_PARAM;
+	}
+	if (gateFile && (trigT == -1)) {
+		printf("*** -G requires -T/-P\n");
+		return ERR_PARAM;
+	}
+	if (recFile && (trigT == -1)) {
+		printf("*** -f requires -T/-P\n");
+		return ERR_PARAM;
+	}
+	if (perfFile && (trigT == -1)) {
+		printf("*** -K requires -T/-P\n");
+		return ERR_PARAM;
+	}
+	if ((fltSeed || fltScript) && (trigT == -1)) {
+		printf("*** -x/-X require -T/-P\n");
+		return ERR_PARAM;
+	}
+	if (fltSeed && fltScript) {
+		printf("*** -x and -X specified, this is not supported\n");
+		return ERR_PARAM;
+	}
+	if ((fltPct < 0) || (fltPct > 100)) {
+		printf("*** illegal -y=%d, must be 0..100\n", fltPct);
+		return ERR_PARAM;
+	}
+	if (fltSeed || fltScript) {
+		if ((ret = FaultInit(&flt, fltScript, fltSeed ? strtoul(fltSeed, NULL, 0) : 0,
+							 fltPct, trigPat != -1)) != ERR_OK)
+			return ret;
+	}
+
+	/* compile schedule before the device is touched */
+	if (sched && ((ret = SchedLoad(&sc, sched)) != ERR_OK))
+		return ret;
+
+	memset(&loop, 0, sizeof(loop));
+	loop.trigT   = trigT;
+	loop.incrT   = incrT;
+	loop.usePat  = (trigPat != -1);
+	loop.abort   = abort;
+	loop.verbose = verbose;
+	loop.precise = precise;
+	loop.irqDrive = irqDrive;
+	loop.autoPct = autoPct;
+	loop.flt     = (fltSeed || fltScript) ? &flt : NULL;
+	loop.hoPath  = hoPath;
+	loop.hoFd    = -1;
+
+	/* before a takeover, it would delay the first trigger */
+	if (precise && ((ret = Calibrate(trigT, &loop.spin)) != EVT_TIMER))
+		return (ret == EVT_ERR) ? ERR_FUNC : ERR_OK;
+
+	/*----------------------+
+	|  take over trigger    |
+	|  loop (-H)            |
+	+----------------------*/
+	if (hoPath) {
+		/* device is configured and started by the running instance */
+		if ((ret = HoConnect(&loop)) == ERR_OK) {
+			ret = LoopRun(&loop, device, perfFile, recFile, gateFile, ctlPath);
+			goto ABORT;
+		}
+		if (ret != HO_NONE)
+			return ret;
+		ret = ERR_OK;
+	}
 
 	/*----------------------+
 	|  open path            |
@@ -198,6 +405,9 @@ int main(int argc, char *argv[])
 		return PrintError("open");
 	}
 
+	/* supported codes from cache or probe */
+	CapInit(&cap, device, reprobe);
+
 	/*----------------------+
 	|  reset                |
 	+----------------------*/
@@ -225,9 +435,16 @@ int main(int argc, char *argv[])
 	/*----------------------+
 	|  time setting [ms]    |
 	+----------------------*/
+	if (((maxT != -1) && ((ret = CapCheck("-u", WDOG_TIME_MAX, maxT * 1000)) != ERR_OK)) ||
+		((minT != -1) && ((ret = CapCheck("-l", WDOG_TIME_MIN, minT * 1000)) != ERR_OK)) ||
+		((irqT != -1) && ((ret = CapCheck("-q", WDOG_TIME_IRQ, irqT * 1000)) != ERR_OK)))
+		goto ABORT;
+
 	if (maxT != -1) {
-		if ((M_setstat(G_path, WDOG_TIME_MAX, maxT * 1000)) < 0) {
-			PrintError("setstat WDOG_TIME_MAX");
+		if (!CapHas(WDOG_TIME_MAX, 1) ||
+			((M_setstat(G_path, WDOG_TIME_MAX, maxT * 1000)) < 0)) {
+			if (CapHas(WDOG_TIME_MAX, 1))
+				PrintError("setstat WDOG_TIME_MAX");
 
 			/* try to set max time with older setstat code */
 			if ((M_setstat(G_path, WDOG_TIME, maxT)) < 0) {
@@ -305,94 +522,30 @@ int main(int argc, char *argv[])
 		GetInfo();
 
 	/*--------------------+
-	|  watch              |
+	|  run schedule       |
 	+--------------------*/
-	loopcnt = 0;
-	loop = 1;
-	if (trigT != -1){
-
-		/* trigger with pattern */
-		if (trigPat != -1) {
-
-			/* get last used pattern */
-			if ((M_getstat(G_path, WDOG_TRIG_PAT, &pat)) < 0) {
-				PrintError("getstat WDOG_TRIG_PAT");
-				goto ABORT;
-			}
-
-			/* compute initial pattern to use */
-			if( pat == WDOG_TRIGPAT(0))
-				patIdx = 1;
-			else
-				patIdx = 0;
-		}
-
-		/* start watchdog */
-		if ((M_setstat(G_path, WDOG_START, 0)) < 0) {
-			PrintError("setstat WDOG_START");
+	if (sched) {
+		ret = SchedRun(&sc, verbose);
+		SchedExit(&sc);
+		if (ret != ERR_OK)
 			goto ABORT;
-		}
-		printf("Watchdog started - trigger all %dmsec\n", trigT);
-
-		/* trigger loop */
-		do {
-			UOS_Delay(trigT);
-			count++;
-
-			/* trigger with pattern */
-			if (trigPat != -1){
-				pat = WDOG_TRIGPAT(patIdx);
-				if (verbose)
-					printf("#%06d: Trigger watchdog with pattern 0x%x after %dms (press any key to abort)\n",
-						count, pat, trigT);
-				if ((M_setstat(G_path, WDOG_TRIG_PAT, pat)) < 0) {
-					PrintError("setstat WDOG_TRIG_PAT");
-					goto ABORT;
-				}
-				patIdx ^= 1;
-			}
-			/* trigger without pattern */
-			else {
-				if (verbose)
-					printf("#%06d: Trigger watchdog after %dms (press any key to abort)\n",
-						count, trigT);
-				if ((M_setstat(G_path, WDOG_TRIG, 0)) < 0) {
-					PrintError("setstat WDOG_TRIG");
-					goto ABORT;
-				}
-			}
-
-			if (!verbose) {
-				printf(".");
-				fflush(stdout);
-			}
-
-			/* increment delay for next pass */
-			if (incrT)
-				trigT += incrT;
-
-			/* repeat until keypress */
-			if (UOS_KeyPressed() != -1)
-				loop = 0;
-
-			/* abort after n passes */
-			if (abort){
-				loopcnt++;
-				if (loopcnt==abort)
-					loop = 0;
-			}
-					
-		} while (loop);
+	}
 
-		if (!verbose)
-			printf("\n");
+	/*--------------------+
+	|  measure timeout    |
+	+--------------------*/
+	if (meas > 0) {
+		if ((ret = MeasureTimeout(meas, verbose)) != ERR_OK)
+			goto ABORT;
+	}
 
-		/* try to stop watchdog */
-		if ((M_setstat(G_path, WDOG_STOP, 0)) < 0) {
-			PrintError("setstat WDOG_STOP");
+	/*--------------------+
+	|  watch              |
+	+--------------------*/
+	if (trigT != -1){
+		ret = LoopRun(&loop, device, perfFile, recFile, gateFile, ctlPath);
+		if ((ret != ERR_OK) || loop.handedOver)
 			goto ABORT;
-		}
-		printf("Watchdog stopped\n");
 	}
 
 	/*----------------------+
@@ -413,25 +566,484 @@ int main(int argc, char *argv[])
 	ret = ERR_OK;
 
 ABORT:
+	/* new instance uses the path now, process exit just drops our fd */
+	if (loop.handedOver)
+		return ret;
+
 	if (M_close(G_path) < 0)
 		ret = PrintError("close");
 
 	return ret;
 }
 
+/***************************************************************************/
+/** Trigger watchdog once
+ *
+ *  \param lp         \IN  loop parameters
+ *  \param badPat     \IN  repeat the last pattern instead of alternating
+ *
+ *  \return           success (0) or error code
+ */
+static int Trigger(WDOG_LOOP *lp, int badPat)
+{
+	int32 pat;
+
+	/* trigger with pattern */
+	if (lp->usePat){
+		pat = WDOG_TRIGPAT(badPat ? lp->patIdx ^ 1 : lp->patIdx);
+		if ((M_setstat(G_path, WDOG_TRIG_PAT, pat)) < 0)
+			return PrintError("setstat WDOG_TRIG_PAT");
+		if (lp->verbose)
+			printf("#%06d: Trigger watchdog with pattern 0x%x after %dms (press any key to abort)\n",
+				lp->count, pat, lp->trigT);
+		if (!badPat)
+			lp->patIdx ^= 1;
+	}
+	/* trigger without pattern */
+	else {
+		if ((M_setstat(G_path, WDOG_TRIG, 0)) < 0)
+			return PrintError("setstat WDOG_TRIG");
+		if (lp->verbose)
+			printf("#%06d: Trigger watchdog after %dms (press any key to abort)\n",
+				lp->count, lp->trigT);
+	}
+
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Calibrate spin time for precision mode (-p)
+ *
+ *  Measures how late the event loop wakes up after a 1ms timer. The
+ *  p99 of the wakeup latency plus a guard of 20us is used as spin
+ *  time: the loop wakes up this time before each deadline and spins
+ *  on the monotonic clock for the rest. The spin time is limited to
+ *  half of the trigger period.
+ *
+ *  \param trigT      \IN  trigger period [ms]
+ *  \param spin       \OUT spin time [us]
+ *
+ *  \return           EVT_TIMER or event that aborted the calibration
+ */
+static int Calibrate(int32 trigT, u_int32 *spin)
+{
+	WDOG_EVT evt;
+	WDOG_STAT st;
+	u_int64 target;
+	int n, ev = EVT_TIMER;
+
+	if (EvtInit(&evt) != ERR_OK)
+		return EVT_ERR;
+
+	StatInit(&st);
+	for (n = 0; n < 200; n++) {
+		target = NowUs() + 1000;
+		EvtArm(&evt, target, 0);
+		if ((ev = EvtWait(&evt)) != EVT_TIMER)
+			break;
+		StatAdd(&st, (u_int32)(NowUs() - target));
+	}
+	EvtExit(&evt);
+
+	*spin = StatPct(&st, 9900) + 20;
+	if (*spin > (u_int32)trigT * 500)
+		*spin = (u_int32)trigT * 500;
+	StatPrint("wakeup latency", &st);
+	printf("Precision mode: spin %uus before each deadline\n", *spin);
+	return ev;
+}
+
+/***************************************************************************/
+/** Start modules of the trigger loop, run it, stop the modules
+ *
+ *  The modules start only after the device is open or taken over, so
+ *  e.g. a failed open keeps the recording of the previous run (-f).
+ *  If a module can't start after a takeover, the watchdog is stopped:
+ *  the old instance doesn't trigger anymore.
+ *
+ *  \param lp         \INOUT loop parameters
+ *  \param device     \IN  device name
+ *  \param perfFile   \IN  -K file or NULL
+ *  \param recFile    \IN  -f file or NULL
+ *  \param gateFile   \IN  -G file or NULL
+ *  \param ctlPath    \IN  -C socket or NULL
+ *
+ *  \return           success (0) or error code
+ */
+static int LoopRun(WDOG_LOOP *lp, const char *device, const char *perfFile,
+				   const char *recFile, const char *gateFile, const char *ctlPath)
+{
+	WDOG_PERF perf;
+	WDOG_REC rec;
+	WDOG_GATE gate;
+	WDOG_CTL ctl;
+	int ret;
+
+	if (perfFile) {
+		if ((ret = PerfInit(&perf, perfFile)) != ERR_OK)
+			goto ABORT;
+		lp->perf = &perf;
+	}
+	if (recFile) {
+		if ((ret = RecInit(&rec, recFile, device)) != ERR_OK)
+			goto ABORT;
+		lp->rec = G_rec = &rec;
+	}
+	if (gateFile) {
+		if ((ret = GateInit(&gate, gateFile)) != ERR_OK)
+			goto ABORT;
+		lp->gate = &gate;
+	}
+	if (ctlPath) {
+		if ((ret = CtlInit(&ctl, ctlPath)) != ERR_OK)
+			goto ABORT;
+		lp->ctl = &ctl;
+	}
+
+	ret = TriggerLoop(lp);
+	if (lp->flt)
+		FaultExit(lp->flt);
+	goto EXIT;
+
+ABORT:
+	if (lp->takeover) {
+		printf("*** can't continue after takeover, stop watchdog\n");
+		if (M_setstat(G_path, WDOG_STOP, 0) < 0)
+			PrintError("setstat WDOG_STOP");
+	}
+
+EXIT:
+	G_rec = NULL;
+	if (lp->perf)
+		PerfExit(lp->perf);
+	if (lp->rec)
+		RecExit(lp->rec);
+	if (lp->gate)
+		GateExit(lp->gate);
+	lp->perf = NULL;
+	lp->rec  = NULL;
+	lp->gate = NULL;
+	lp->ctl  = NULL;
+	return ret;
+}
+
+/***************************************************************************/
+/** Start watchdog, trigger it until keypress/termination/abort, stop it
+ *
+ *  All waiting is done in EvtWait(), so a keypress or SIGTERM/SIGINT
+ *  leads to WDOG_STOP without waiting for the end of the trigger period.
+ *
+ *  \param lp         \IN  loop parameters
+ *
+ *  \return           success (0) or error code
+ */
+static int TriggerLoop(WDOG_LOOP *lp)
+{
+	WDOG_EVT evt;
+	WDOG_FAULT_EV fev;
+	WDOG_STAT errSt, spinSt, irqSt;
+	WDOG_AUTO au;
+	u_int64 base, now, wake, start = 0, first, last, pass, end;
+	u_int32 spin = lp->spin, fallback = 0;
+	int32 pat, n;
+	int ev, periodic, delayed = 0, gated, trig, ran = 0, ret = ERR_OK;
+	int lfd = -1, cfd = -1;
+
+	if ((ret = EvtInit(&evt)) != ERR_OK)
+		return ret;
+
+	/* precision mode: wake up <spin> early, spin until deadline */
+	StatInit(&errSt);
+	StatInit(&spinSt);
+	StatInit(&irqSt);
+
+	/* -Q: irq signal wakes the loop, -C: queued command wakes the loop */
+	if (lp->irqDrive || lp->ctl) {
+		if (EvtWakeInit(&evt) != ERR_OK) {
+			printf("*** %s not supported on this system\n",
+				lp->irqDrive ? "-Q" : "-C");
+			ret = ERR_FUNC;
+			goto EXIT;
+		}
+		if (lp->irqDrive)
+			G_irqEvt = &evt;
+	}
+
+	/* taken over: started, pattern index and deadline from old instance */
+	if (lp->takeover)
+		goto STARTED;
+
+	/* trigger with pattern */
+	if (lp->usePat) {
+
+		/* get last used pattern */
+		if ((M_getstat(G_path, WDOG_TRIG_PAT, &pat)) < 0) {
+			ret = PrintError("getstat WDOG_TRIG_PAT");
+			goto EXIT;
+		}
+
+		/* compute initial pattern to use */
+		if( pat == WDOG_TRIGPAT(0))
+			lp->patIdx = 1;
+		else
+			lp->patIdx = 0;
+	}
+
+	/* start watchdog */
+	if ((M_setstat(G_path, WDOG_START, 0)) < 0) {
+		ret = PrintError("setstat WDOG_START");
+		goto EXIT;
+	}
+	if (lp->irqDrive)
+		printf("Watchdog started - trigger at irq, fallback after %dmsec\n",
+			lp->trigT);
+	else
+		printf("Watchdog started - trigger all %dmsec\n", lp->trigT);
+
+	/* new instances connect to take over (-H) */
+	if (lp->hoPath &&
+		(((lfd = HoListen(lp->hoPath)) < 0) || (EvtWatch(&evt, lfd) != ERR_OK))) {
+		ret = ERR_FUNC;
+		goto STOP;
+	}
+
+STARTED:
+	if (lp->ctl && ((ret = CtlStart(lp->ctl, &evt)) != ERR_OK))
+		goto STOP;
+	if ((lp->autoPct != -1) &&
+		((ret = AutoInit(&au, lp->autoPct, &lp->trigT)) != ERR_OK))
+		goto STOP;
+	if (lp->rec)
+		RecStart(lp->rec, lp->trigT, lp->takeover);
+
+	/* periodic timer, re-armed each pass only for -I, -a, fault injection
+	   and as fallback for -Q */
+	periodic = !lp->incrT && !lp->flt && !lp->irqDrive && (lp->autoPct == -1);
+	start = last = pass = NowUs();
+	first = lp->takeover ? lp->hoNext : start + (u_int64)lp->trigT * 1000;
+	EvtArm(&evt, first - spin, periodic ? lp->trigT * 1000 : 0);
+	if (lp->flt)
+		lp->flt->start = start;
+	if (lp->perf)
+		PerfMark(lp->perf);
+
+	/* trigger loop */
+	while (((ev = EvtWait(&evt)) == EVT_TIMER) || (ev == EVT_FD) ||
+		   (ev == EVT_WAKE)) {
+
+		/* new instance wants to take over after the next trigger */
+		if (ev == EVT_FD) {
+			n = HoAccept(lfd);
+			if (cfd < 0)
+				cfd = n;
+#ifdef LINUX
+			else if (n >= 0)
+				close(n);
+#endif
+			continue;
+		}
+
+		if (ev == EVT_WAKE) {
+			/* -C: apply queued commands between passes */
+			if (lp->ctl && CtlApply(lp->ctl, lp))
+				EvtArm(&evt, pass + (u_int64)lp->trigT * 1000 - spin,
+					   periodic ? lp->trigT * 1000 : 0);
+
+			/* -Q: irq signal, ignore one from before the last trigger */
+			if (!lp->irqDrive || ((base = IrqAt()) < last))
+				continue;
+		}
+		else {
+			base = evt.deadline + spin;
+			if (lp->irqDrive)
+				fallback++;
+		}
+
+		if (lp->precise) {
+			wake = now = NowUs();
+			if (now < base) {
+				while ((now = NowUs()) < base)
+					;
+				StatAdd(&spinSt, (u_int32)(now - wake));
+			}
+			StatAdd(&errSt, (u_int32)(now - base));
+		}
+
+		/* delayed trigger due: schedule continues from now on */
+		if (delayed)
+			delayed = 0;
+		else if (lp->flt) {
+			if (FaultNext(lp->flt, lp->count + 1, lp->trigT, &fev)
+				== FAULT_DELAY) {
+				delayed = 1;
+				EvtArm(&evt, base + (u_int64)fev.arg * 1000 - spin, 0);
+				continue;
+			}
+		}
+		else
+			fev.kind = FAULT_NONE;
+
+		if (lp->perf)
+			PerfPhase(lp->perf, PERF_WAIT);
+		lp->count++;
+
+		/* -G: gate closed, let the watchdog expire */
+		gated = lp->gate && !GateOpen(lp->gate);
+		trig = !gated && (fev.kind != FAULT_SKIP);
+
+		switch (gated ? FAULT_SKIP : fev.kind) {
+		case FAULT_SKIP:
+			break;
+		case FAULT_BURST:
+			for (n = 0; n < fev.arg && ret == ERR_OK; n++)
+				ret = Trigger(lp, 0);
+			break;
+		default:
+			ret = Trigger(lp, fev.kind == FAULT_BADPAT);
+		}
+		if (lp->rec) {
+			if (gated)
+				RecAdd(lp->rec, REC_GATED, lp->count, 0, 0);
+			else if (fev.kind == FAULT_SKIP)
+				RecAdd(lp->rec, REC_FAULT, lp->count, 0, FAULT_SKIP);
+			else
+				RecAdd(lp->rec, REC_TRIG, lp->count,
+					   ret == ERR_OK ? 0 : UOS_ErrnoGet(), fev.kind);
+		}
+		if (ret != ERR_OK)
+			goto EXIT;
+		pass = NowUs();
+		if (trig) {
+			last = pass;
+			if (ev == EVT_WAKE)
+				StatAdd(&irqSt, (u_int32)(last - base));
+		}
+		if (lp->perf) {
+			PerfPhase(lp->perf, PERF_TRIG);
+			PerfPass(lp->perf, lp->count, base);
+		}
+
+		/* first trigger after takeover: release old instance */
+		if (trig && (lp->hoFd >= 0)) {
+			HoConfirm(lp, last);
+
+			/* we own the watchdog now: keep triggering without -H */
+			if (((lfd = HoListen(lp->hoPath)) >= 0) &&
+				(EvtWatch(&evt, lfd) != ERR_OK)) {
+#ifdef LINUX
+				close(lfd);
+				unlink(lp->hoPath);
+#endif
+				lfd = -1;
+			}
+			if (lfd < 0)
+				printf("*** handover: can't listen again, no further takeover\n");
+		}
+
+		if (lp->flt)
+			FaultLog(lp->flt, &fev);
+		else if (!lp->verbose && trig) {
+			printf(".");
+			fflush(stdout);
+		}
+
+		/* increment delay or adjust period for next pass */
+		lp->trigT += lp->incrT;
+		if ((lp->autoPct != -1) && trig)
+			lp->trigT = AutoPass(&au, (u_int32)(last - base));
+		if (!periodic)
+			EvtArm(&evt, base + (u_int64)lp->trigT * 1000 - spin, 0);
+
+		/* hand over right after a trigger, the new instance owns the
+		   watchdog once it has the state */
+		if (trig && (cfd >= 0)) {
+			n = HoHandOver(cfd, lp, last, evt.next + spin);
+			cfd = -1;
+			if (n == ERR_OK) {
+				lp->handedOver = 1;
+				if (lp->rec)
+					RecAdd(lp->rec, REC_HANDOVER, lp->count, 0, 0);
+				goto EXIT;
+			}
+		}
+
+		/* abort after n passes */
+		if ((lp->abort > 0) && (lp->count == (u_int32)lp->abort))
+			break;
+	}
+
+	if (ev == EVT_ERR)
+		ret = ERR_FUNC;
+	ran = 1;
+
+STOP:
+	/* try to stop watchdog, report afterwards */
+	n = M_setstat(G_path, WDOG_STOP, 0);
+	end = NowUs();
+	if (lp->rec)
+		RecAdd(lp->rec, REC_STOP, lp->count, n < 0 ? UOS_ErrnoGet() : 0, 0);
+	if (ran && !lp->verbose && !lp->flt)
+		printf("\n");
+	if (n < 0)
+		ret = PrintError("setstat WDOG_STOP");
+	else
+		printf("Watchdog stopped\n");
+	if (!ran)
+		goto EXIT;
+
+	if (evt.overrun)
+		printf("*** %d trigger deadline(s) missed\n", evt.overrun);
+	if (lp->autoPct != -1)
+		AutoExit(&au);
+	if (lp->irqDrive) {
+		printf("%-22s: %u by irq, %u by fallback timer\n", "triggers",
+			irqSt.count, fallback);
+		StatPrint("irq to trigger", &irqSt);
+	}
+	if (lp->precise) {
+		StatPrint("deadline error", &errSt);
+		StatPrint("spin time", &spinSt);
+		printf("%-22s: %llums of %llums (%.2f%%)\n", "CPU time spinning",
+			(unsigned long long)(spinSt.sum / 1000),
+			(unsigned long long)((end - start) / 1000),
+			100.0 * spinSt.sum / (end - start + 1));
+	}
+
+EXIT:
+	G_irqEvt = NULL;
+	/* socket file belongs to the new instance after handover */
+	if (lp->ctl)
+		CtlExit(lp->ctl, !lp->handedOver);
+#ifdef LINUX
+	if (cfd >= 0)
+		close(cfd);
+	if (lfd >= 0) {
+		close(lfd);
+		/* socket file belongs to the new instance after handover */
+		if (!lp->handedOver)
+			unlink(lp->hoPath);
+	}
+#endif
+	EvtExit(&evt);
+	return ret;
+}
+
 /***************************************************************************/
 /** Read and print input values
 *
 *  \return           success (0) or error code
 */
-static int GetInfo(void)
+int GetInfo(void)
 {
 	int32 val;
 	char *str;
 
 	/* ----------- codes before 2016 ----------- */
 	printf("WDOG_TIME (MAX time)                  : ");
-	if ((M_getstat(G_path, WDOG_TIME, &val)) < 0) {
+	if (!CapHas(WDOG_TIME, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_TIME, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -439,7 +1051,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_STATUS (counter state)           : ");
-	if ((M_getstat(G_path, WDOG_STATUS, &val)) < 0) {
+	if (!CapHas(WDOG_STATUS, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_STATUS, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -447,7 +1062,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_SHOT (shot info)                 : ");
-	if ((M_getstat(G_path, WDOG_SHOT, &val)) < 0) {
+	if (!CapHas(WDOG_SHOT, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_SHOT, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -462,7 +1080,10 @@ static int GetInfo(void)
 
 	/* ----------- additional codes since 2016 ----------- */
 	printf("WDOG_TRIG_PAT (last used pattern)     : ");
-	if ((M_getstat(G_path, WDOG_TRIG_PAT, &val)) < 0) {
+	if (!CapHas(WDOG_TRIG_PAT, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_TRIG_PAT, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -470,7 +1091,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_TIME_MIN (MIN time)              : ");
-	if ((M_getstat(G_path, WDOG_TIME_MIN, &val)) < 0) {
+	if (!CapHas(WDOG_TIME_MIN, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_TIME_MIN, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -478,7 +1102,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_TIME_MAX (MAX time)              : ");
-	if ((M_getstat(G_path, WDOG_TIME_MAX, &val)) < 0) {
+	if (!CapHas(WDOG_TIME_MAX, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_TIME_MAX, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -486,7 +1113,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_TIME_IRQ (IRQ time)              : ");
-	if ((M_getstat(G_path, WDOG_TIME_IRQ, &val)) < 0) {
+	if (!CapHas(WDOG_TIME_IRQ, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_TIME_IRQ, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -494,7 +1124,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_OUT_PIN (out pin)                : ");
-	if ((M_getstat(G_path, WDOG_OUT_PIN, &val)) < 0) {
+	if (!CapHas(WDOG_OUT_PIN, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_OUT_PIN, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -502,7 +1135,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_OUT_REASON (last out pin reason) : ");
-	if ((M_getstat(G_path, WDOG_OUT_REASON, &val)) < 0) {
+	if (!CapHas(WDOG_OUT_REASON, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_OUT_REASON, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -517,7 +1153,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_IRQ_PIN (irq pin)                : ");
-	if ((M_getstat(G_path, WDOG_IRQ_PIN, &val)) < 0) {
+	if (!CapHas(WDOG_IRQ_PIN, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_IRQ_PIN, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -525,7 +1164,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_IRQ_REASON (last irq pin reason) : ");
-	if ((M_getstat(G_path, WDOG_IRQ_REASON, &val)) < 0) {
+	if (!CapHas(WDOG_IRQ_REASON, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_IRQ_REASON, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -539,7 +1181,10 @@ static int GetInfo(void)
 	}
 
 	printf("WDOG_ERR_PIN (err pin)                : ");
-	if ((M_getstat(G_path, WDOG_ERR_PIN, &val)) < 0) {
+	if (!CapHas(WDOG_ERR_PIN, 0)) {
+		printf("not supported\n");
+	}
+	else if ((M_getstat(G_path, WDOG_ERR_PIN, &val)) < 0) {
 		PRINT_ERR
 	}
 	else {
@@ -549,6 +1194,27 @@ static int GetInfo(void)
 	return ERR_OK;
 }
 
+/***************************************************************************/
+/** Get time of last irq signal (-Q)
+ *
+ *  G_irqAt is not written atomically on 32-bit targets. The signal
+ *  handler runs in the trigger thread (other threads block signals),
+ *  so it can only interrupt this read: read again if G_irqSeq changed.
+ *
+ *  \return           time of last irq signal [us]
+ */
+static u_int64 IrqAt(void)
+{
+	sig_atomic_t seq;
+	u_int64 at;
+
+	do {
+		seq = G_irqSeq;
+		at = G_irqAt;
+	} while (seq != G_irqSeq);
+	return at;
+}
+
 /***************************************************************************/
 /** Signal handler
 *
@@ -558,6 +1224,16 @@ static void __MAPILIB SignalHandler(u_int32 sig)
 {
 	if (sig == UOS_SIG_USR1) {
 		++G_sigCount;
+		if (G_rec)
+			RecAdd(G_rec, REC_IRQ, G_sigCount, 0, 0);
+
+		/* -Q: the trigger loop triggers, no output here */
+		if (G_irqEvt) {
+			G_irqAt = NowUs();
+			G_irqSeq++;
+			EvtWake(G_irqEvt);
+			return;
+		}
 
 		printf("==> interrupt signal #%d received\n", G_sigCount);
 
@@ -576,7 +1252,7 @@ static void __MAPILIB SignalHandler(u_int32 sig)
  *
  *  \return           ERR_FUNC
  */
-static int PrintError(char *info)
+int PrintError(char *info)
 {
 	printf("*** can't %s: %s\n", info, M_errstring (UOS_ErrnoGet()));
 	return ERR_FUNC;
@@ -0,0 +1,200 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_AUTO                    ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_auto.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Self-tuning trigger period (-a)
+ *
+ *               The longest safe period is
+ *
+ *                 max. time * (100 - margin) / 100 - latency tail
+ *
+ *               with the latency from the deadline until the trigger
+ *               setstat returned. The tail is the largest p99.99 of the
+ *               last AUTO_NWIN windows of AUTO_WIN passes each.
+ *
+ *               A latency above the tail raises the tail at once and
+ *               shortens the period in the same pass. A shrinking tail
+ *               lengthens the period only at the end of a window and by
+ *               at most AUTO_STEP percent per window. The period never
+ *               gets below the min. time plus margin. A start period
+ *               (-T/-P) above max. time minus margin is shortened before
+ *               the first trigger.
+ *
+ *    \switches  (none)
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define AUTO_WIN	1000	/**< passes per window */
+#define AUTO_STEP	10		/**< max. lengthening per window [%] */
+
+/***************************************************************************/
+/** Initialize auto period, get max./min. time of the watchdog
+ *
+ *  \param au         \OUT auto period
+ *  \param margin     \IN  safety margin [% of max. time]
+ *  \param trigT      \INOUT start period [ms], limited to the margin
+ *
+ *  \return           success (0) or error code
+ */
+int AutoInit(WDOG_AUTO *au, int32 margin, int32 *trigT)
+{
+	int32 maxT, minT = 0;
+
+	memset(au, 0, sizeof(*au));
+
+	if (CapMaxTime(&maxT) < 0)
+		return PrintError("getstat WDOG_TIME");
+	if (!CapHas(WDOG_TIME_MIN, 0) || (M_getstat(G_path, WDOG_TIME_MIN, &minT) < 0))
+		minT = 0;
+	if (maxT <= 0) {
+		printf("*** -a requires a max. time (-u)\n");
+		return ERR_PARAM;
+	}
+
+	au->margin = margin;
+	au->limit = (u_int32)((u_int64)maxT * (100 - margin) / 100);
+	au->minPeriod = (u_int32)(((u_int64)minT * (100 + margin) / 100 + 999) / 1000);
+	if (au->minPeriod < 1)
+		au->minPeriod = 1;
+
+	printf("Auto period: max. time %dus, margin %d%% -> limit %uus, min. period %ums\n",
+		maxT, margin, au->limit, au->minPeriod);
+
+	/* the first window would come too late */
+	if ((u_int64)*trigT * 1000 > au->limit) {
+		if (au->limit / 1000 < au->minPeriod) {
+			printf("*** -a: no period between min. and max. time keeps "
+				   "a margin of %d%%\n", margin);
+			return ERR_PARAM;
+		}
+		printf("Auto period: start period %dms -> %ums (limit)\n",
+			*trigT, au->limit / 1000);
+		*trigT = (int32)(au->limit / 1000);
+	}
+	au->period = au->minT = au->maxT = *trigT;
+	StatInit(&au->win);
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Set new period and log it
+ *
+ *  \param au         \INOUT auto period
+ *  \param period     \IN  wanted period [ms]
+ *  \param reason     \IN  reason for the log
+ */
+static void AutoSet(WDOG_AUTO *au, u_int32 period, const char *reason)
+{
+	if (period < au->minPeriod) {
+		if (!au->clamped)
+			printf("*** auto period: margin can't be kept, period limited to %ums\n",
+				au->minPeriod);
+		au->clamped = 1;
+		period = au->minPeriod;
+	}
+	if (period == au->period)
+		return;
+
+	printf("Auto period: %ums -> %ums (%s, tail %uus)\n",
+		au->period, period, reason, au->tail);
+	au->period = period;
+	au->changes++;
+	if (au->period < au->minT)
+		au->minT = au->period;
+	if (au->period > au->maxT)
+		au->maxT = au->period;
+}
+
+/***************************************************************************/
+/** Add latency of a pass, adjust period
+ *
+ *  \param au         \INOUT auto period
+ *  \param lat        \IN  deadline to trigger done [us]
+ *
+ *  \return           period for the next pass [ms]
+ */
+int32 AutoPass(WDOG_AUTO *au, u_int32 lat)
+{
+	u_int32 i, tail, target, step;
+	char reason[64];
+
+	StatAdd(&au->win, lat);
+
+	/* tail grows: shorten now */
+	if (lat > au->tail) {
+		au->tail = lat;
+		target = au->limit > lat ? (au->limit - lat) / 1000 : 0;
+		if (target < au->period) {
+			snprintf(reason, sizeof(reason), "latency %uus above tail", lat);
+			AutoSet(au, target, reason);
+		}
+	}
+	if (au->win.count < AUTO_WIN)
+		return (int32)au->period;
+
+	/* end of window: tail = largest p99.99 of the last windows */
+	au->pct[au->idx] = StatPct(&au->win, 9999);
+	au->idx = (au->idx + 1) % AUTO_NWIN;
+	if (au->nWin < AUTO_NWIN)
+		au->nWin++;
+	StatInit(&au->win);
+	for (i = 0, tail = 0; i < au->nWin; i++)
+		if (au->pct[i] > tail)
+			tail = au->pct[i];
+	au->tail = tail;
+
+	/* lengthen slowly */
+	target = (au->limit - (au->limit > tail ? tail : au->limit)) / 1000;
+	step = au->period + (au->period * AUTO_STEP + 99) / 100;
+	snprintf(reason, sizeof(reason), "p99.99 of last %u passes", au->nWin * AUTO_WIN);
+	AutoSet(au, target < step ? target : step, reason);
+
+	return (int32)au->period;
+}
+
+/***************************************************************************/
+/** Print summary
+ *
+ *  \param au         \IN  auto period
+ */
+void AutoExit(WDOG_AUTO *au)
+{
+	printf("Auto period: %ums at end, %ums..%ums, %u changes, tail %uus\n",
+		au->period, au->minT, au->maxT, au->changes, au->tail);
+}
@@ -0,0 +1,515 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_CAP                     ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_cap.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Cached capabilities of a device (-k)
+ *
+ *               The first start for a device probes which codes of
+ *               G_wdogCode the driver supports with getstat only, readable
+ *               time codes are assumed to be settable. The result is
+ *               stored in CAP_FILE, one line per device, keyed by device
+ *               name and a hash of the driver revision (M_MK_BLK_REV_ID).
+ *               Later starts use the line and call only supported codes,
+ *               e.g. -u sets WDOG_TIME at once on drivers without
+ *               WDOG_TIME_MAX and -g prints "not supported" instead of
+ *               errors. A driver update changes the hash and so probes
+ *               again.
+ *
+ *               -k probes again with the watchdog stopped: setstat for
+ *               the time codes by writing back the current value, and
+ *               the value range and resolution of the time codes: the
+ *               smallest and largest value the driver accepts and the
+ *               smallest step (1, 10, 100, ...) that reads back exactly.
+ *               The original values are restored. -u/-l/-q values out
+ *               of a known range are rejected without a setstat. With
+ *               the watchdog running, nothing is written and the result
+ *               is not cached.
+ *
+ *               CAP_DIR is created with mode 0700. The cache is only
+ *               used if CAP_DIR is owned by root or the user and the file
+ *               by the user, both not writable for group and others.
+ *
+ *               Line format:
+ *                 <device> <rev hash> <get mask> <set mask>
+ *                   [<code name>:<min>:<max>:<resolution> ...]
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef LINUX
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/stat.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define CAP_DIR		"/var/cache/wdog_ctrl"
+#define CAP_FILE	CAP_DIR "/wdog_ctrl.cap"
+#define CAP_LINE	512		/**< max. line length */
+#define CAP_MAXVAL	0x7fffffff
+
+/*--------------------------------------+
+|   GLOBALS                             |
++--------------------------------------*/
+/* capabilities of the open device, NULL = unknown (try everything) */
+static WDOG_CAP *G_cap;
+
+/***************************************************************************/
+/** Get index of code in G_wdogCode
+ *
+ *  \param code       \IN  WDOG_xxx
+ *
+ *  \return           index or -1
+ */
+static int CapIdx(int32 code)
+{
+	int i;
+
+	for (i = 0; i < WDOG_CODES; i++)
+		if (G_wdogCode[i].code == code)
+			return i;
+	return -1;
+}
+
+/***************************************************************************/
+/** Check if code is a time code with value range
+ *
+ *  \param code       \IN  WDOG_xxx
+ *
+ *  \return           1 if time code
+ */
+static int CapIsTime(int32 code)
+{
+	return (code == WDOG_TIME) || (code == WDOG_TIME_MIN) ||
+		(code == WDOG_TIME_MAX) || (code == WDOG_TIME_IRQ);
+}
+
+/***************************************************************************/
+/** Hash driver revision (FNV-1a)
+ *
+ *  \param rev        \OUT hash, 0 if revision unknown
+ */
+static void CapRev(u_int32 *rev)
+{
+	M_SG_BLOCK blk;
+	char buf[256];
+	u_int32 h = 2166136261UL;
+	char *s;
+
+	memset(buf, 0, sizeof(buf));
+	blk.size = sizeof(buf) - 1;
+	blk.data = (void*)buf;
+	if (M_getstat(G_path, M_MK_BLK_REV_ID, (int32*)&blk) < 0) {
+		*rev = 0;
+		return;
+	}
+	for (s = buf; *s; s++)
+		h = (h ^ (u_int8)*s) * 16777619UL;
+	*rev = h ? h : 1;
+}
+
+/***************************************************************************/
+/** Check if value is accepted, get value read back
+ *
+ *  \param code       \IN  time code
+ *  \param val        \IN  value to set
+ *  \param back       \OUT value read back
+ *
+ *  \return           1 if accepted
+ */
+static int CapTry(int32 code, int32 val, int32 *back)
+{
+	if (M_setstat(G_path, code, val) < 0)
+		return 0;
+	if (M_getstat(G_path, code, back) < 0)
+		*back = val;
+	return 1;
+}
+
+/***************************************************************************/
+/** Probe range and resolution of time code, restore value
+ *
+ *  \param cap        \INOUT capabilities
+ *  \param i          \IN  index in G_wdogCode
+ */
+static void CapRange(WDOG_CAP *cap, int i)
+{
+	int32 code = G_wdogCode[i].code;
+	int32 orig, lo, hi, mid, back, d;
+
+	if (M_getstat(G_path, code, &orig) < 0)
+		return;
+
+	/* smallest accepted value (0 may disable, start with 1) */
+	if (CapTry(code, 1, &back))
+		cap->min[i] = back;
+	else if (orig > 1) {
+		for (lo = 1, hi = orig; hi - lo > 1; ) {
+			mid = lo + (hi - lo) / 2;
+			if (CapTry(code, mid, &back))
+				hi = mid;
+			else
+				lo = mid;
+		}
+		cap->min[i] = CapTry(code, hi, &back) ? back : hi;
+	}
+
+	/* largest accepted value */
+	if (CapTry(code, CAP_MAXVAL, &back))
+		cap->max[i] = back;
+	else {
+		for (lo = orig > 0 ? orig : 1, hi = CAP_MAXVAL; hi - lo > 1; ) {
+			mid = lo + (hi - lo) / 2;
+			if (CapTry(code, mid, &back))
+				lo = mid;
+			else
+				hi = mid;
+		}
+		cap->max[i] = CapTry(code, lo, &back) ? back : lo;
+	}
+
+	/* smallest step that reads back exactly */
+	for (d = 1; cap->min[i] && (d <= 100000); d *= 10) {
+		if ((cap->min[i] + d <= cap->max[i]) &&
+			CapTry(code, cap->min[i] + d, &back) && (back == cap->min[i] + d)) {
+			cap->res[i] = d;
+			break;
+		}
+	}
+
+	M_setstat(G_path, code, orig);
+}
+
+/***************************************************************************/
+/** Probe capabilities of the open device
+ *
+ *  Without sets, readable time codes are assumed to be settable.
+ *
+ *  \param cap        \INOUT capabilities, rev set
+ *  \param sets       \IN  probe setstat and ranges of the time codes
+ *
+ *  \return           1 if the result may be cached
+ */
+static int CapProbe(WDOG_CAP *cap, int32 sets)
+{
+	int32 val, status = 0;
+	int i;
+
+	cap->get = cap->set = 0;
+	memset(cap->min, 0, sizeof(cap->min));
+	memset(cap->max, 0, sizeof(cap->max));
+	memset(cap->res, 0, sizeof(cap->res));
+
+	/* a running watchdog may refuse time changes */
+	if (sets && (M_getstat(G_path, WDOG_STATUS, &status) == 0) && status) {
+		printf("watchdog running - setstat and time ranges not probed, "
+			   "not cached\n");
+		sets = 0;
+	}
+
+	for (i = 0; i < WDOG_CODES; i++) {
+		if (M_getstat(G_path, G_wdogCode[i].code, &val) < 0)
+			continue;
+		cap->get |= 1 << i;
+		if (!CapIsTime(G_wdogCode[i].code))
+			continue;
+
+		/* write back current value, no state change */
+		if (!sets || (M_setstat(G_path, G_wdogCode[i].code, val) == 0))
+			cap->set |= 1 << i;
+	}
+
+	if (!sets)
+		return !status;
+	for (i = 0; i < WDOG_CODES; i++)
+		if (cap->set & (1 << i))
+			CapRange(cap, i);
+	return 1;
+}
+
+/***************************************************************************/
+/** Open cache file for reading, only if it can be trusted
+ *
+ *  \return           file or NULL
+ */
+static FILE *CapOpen(void)
+{
+#ifdef LINUX
+	struct stat st;
+	FILE *fp;
+	int fd;
+
+	if ((lstat(CAP_DIR, &st) < 0) || !S_ISDIR(st.st_mode) ||
+		((st.st_uid != 0) && (st.st_uid != geteuid())) ||
+		(st.st_mode & (S_IWGRP | S_IWOTH)))
+		return NULL;
+
+	if ((fd = open(CAP_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) < 0)
+		return NULL;
+	if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) ||
+		(st.st_uid != geteuid()) || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+		!(fp = fdopen(fd, "r"))) {
+		close(fd);
+		return NULL;
+	}
+	return fp;
+#else
+	return NULL;
+#endif
+}
+
+/***************************************************************************/
+/** Create temp file for the new cache in CAP_DIR
+ *
+ *  \param tmp        \OUT name of temp file
+ *  \param size       \IN  size of tmp
+ *
+ *  \return           file or NULL
+ */
+static FILE *CapCreate(char *tmp, size_t size)
+{
+#ifdef LINUX
+	struct stat st;
+	FILE *fp;
+	int fd;
+
+	mkdir(CAP_DIR, 0700);
+	if ((lstat(CAP_DIR, &st) < 0) || !S_ISDIR(st.st_mode) ||
+		((st.st_uid != 0) && (st.st_uid != geteuid())) ||
+		(st.st_mode & (S_IWGRP | S_IWOTH)))
+		return NULL;
+
+	snprintf(tmp, size, "%s.XXXXXX", CAP_FILE);
+	if ((fd = mkstemp(tmp)) < 0)
+		return NULL;
+	if (!(fp = fdopen(fd, "w"))) {
+		close(fd);
+		remove(tmp);
+	}
+	return fp;
+#else
+	return NULL;
+#endif
+}
+
+/***************************************************************************/
+/** Parse cache line
+ *
+ *  \param line       \IN  line
+ *  \param device     \IN  device name
+ *  \param cap        \OUT capabilities
+ *
+ *  \return           1 if line is for device, else 0
+ */
+static int CapParse(char *line, const char *device, WDOG_CAP *cap)
+{
+	char *tok, *save = NULL, *p;
+	int i;
+
+	if (!(tok = strtok_r(line, " \t\n", &save)) || strcmp(tok, device))
+		return 0;
+	if (!(tok = strtok_r(NULL, " \t\n", &save)))
+		return 0;
+	cap->rev = (u_int32)strtoul(tok, NULL, 16);
+	if (!(tok = strtok_r(NULL, " \t\n", &save)))
+		return 0;
+	cap->get = (u_int32)strtoul(tok, NULL, 16);
+	if (!(tok = strtok_r(NULL, " \t\n", &save)))
+		return 0;
+	cap->set = (u_int32)strtoul(tok, NULL, 16);
+
+	while ((tok = strtok_r(NULL, " \t\n", &save))) {
+		if (!(p = strchr(tok, ':')))
+			continue;
+		*p++ = '\0';
+		for (i = 0; i < WDOG_CODES; i++)
+			if (!strcmp(tok, G_wdogCode[i].name))
+				break;
+		if (i < WDOG_CODES)
+			sscanf(p, "%d:%d:%d", &cap->min[i], &cap->max[i], &cap->res[i]);
+	}
+	return 1;
+}
+
+/***************************************************************************/
+/** Store capabilities in cache file
+ *
+ *  Other lines are kept. Written to a temp file and renamed, so
+ *  parallel invocations never see a partial file.
+ *
+ *  \param device     \IN  device name
+ *  \param cap        \IN  capabilities
+ */
+static void CapSave(const char *device, const WDOG_CAP *cap)
+{
+	char line[CAP_LINE], copy[CAP_LINE], tmp[64];
+	WDOG_CAP other;
+	FILE *in, *out;
+	int i;
+
+	if (!(out = CapCreate(tmp, sizeof(tmp))))
+		return;
+
+	if ((in = CapOpen())) {
+		while (fgets(line, sizeof(line), in)) {
+			strcpy(copy, line);
+			if (!CapParse(copy, device, &other))
+				fputs(line, out);
+		}
+		fclose(in);
+	}
+
+	fprintf(out, "%s %08x %x %x", device, cap->rev, cap->get, cap->set);
+	for (i = 0; i < WDOG_CODES; i++)
+		if (cap->max[i])
+			fprintf(out, " %s:%d:%d:%d", G_wdogCode[i].name,
+				cap->min[i], cap->max[i], cap->res[i]);
+	fprintf(out, "\n");
+
+	if ((fclose(out) != 0) || (rename(tmp, CAP_FILE) != 0))
+		remove(tmp);
+}
+
+/***************************************************************************/
+/** Get capabilities of the open device from cache or by probing
+ *
+ *  \param cap        \OUT capabilities
+ *  \param device     \IN  device name
+ *  \param reprobe    \IN  probe again incl. time ranges (-k)
+ */
+void CapInit(WDOG_CAP *cap, const char *device, int32 reprobe)
+{
+	char line[CAP_LINE];
+	u_int32 rev;
+	FILE *fp;
+	int found = 0, cache, i;
+
+	memset(cap, 0, sizeof(*cap));
+	CapRev(&rev);
+
+	/* unknown revision: no reliable key, don't cache */
+	if (!rev && !reprobe)
+		return;
+
+	if (!reprobe && (fp = CapOpen())) {
+		while (!found && fgets(line, sizeof(line), fp))
+			found = CapParse(line, device, cap) && (cap->rev == rev);
+		fclose(fp);
+	}
+
+	if (!found) {
+		memset(cap, 0, sizeof(*cap));
+		cap->rev = rev;
+		cache = CapProbe(cap, reprobe);
+		if (rev && cache)
+			CapSave(device, cap);
+	}
+	G_cap = cap;
+
+	if (reprobe) {
+		printf("Capabilities of %s (rev %08x):\n", device, rev);
+		for (i = 0; i < WDOG_CODES; i++) {
+			printf("  %-16s %-3s %-3s", G_wdogCode[i].name,
+				cap->get & (1 << i) ? "get" : "-",
+				cap->set & (1 << i) ? "set" : "-");
+			if (cap->max[i])
+				printf(" %d..%d, resolution %d", cap->min[i], cap->max[i],
+					cap->res[i]);
+			printf("\n");
+		}
+	}
+}
+
+/***************************************************************************/
+/** Check if code is supported
+ *
+ *  \param code       \IN  WDOG_xxx
+ *  \param set        \IN  0=getstat, 1=setstat
+ *
+ *  \return           0 if known as unsupported, else 1
+ */
+int CapHas(int32 code, int32 set)
+{
+	int i;
+
+	if (!G_cap || ((i = CapIdx(code)) < 0) || (set && !CapIsTime(code)))
+		return 1;
+	return ((set ? G_cap->set : G_cap->get) & (1 << i)) != 0;
+}
+
+/***************************************************************************/
+/** Check value against known range of time code
+ *
+ *  \param opt        \IN  option name for the message
+ *  \param code       \IN  time code
+ *  \param val        \IN  value in units of the code
+ *
+ *  \return           success (0) or ERR_PARAM
+ */
+int CapCheck(const char *opt, int32 code, int32 val)
+{
+	int i;
+
+	/* 0 disables */
+	if (!G_cap || !val || ((i = CapIdx(code)) < 0) || !G_cap->max[i])
+		return ERR_OK;
+	if ((val < G_cap->min[i]) || (val > G_cap->max[i])) {
+		printf("*** %s: %d out of range %d..%d of %s\n", opt, val,
+			G_cap->min[i], G_cap->max[i], G_wdogCode[i].name);
+		return ERR_PARAM;
+	}
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Get max. time, with WDOG_TIME on drivers without WDOG_TIME_MAX
+ *
+ *  \param maxT       \OUT max. time [us]
+ *
+ *  \return           0 or -1 on error
+ */
+int CapMaxTime(int32 *maxT)
+{
+	if (CapHas(WDOG_TIME_MAX, 0) && (M_getstat(G_path, WDOG_TIME_MAX, maxT) == 0))
+		return 0;
+	if (M_getstat(G_path, WDOG_TIME, maxT) < 0)
+		return -1;
+	*maxT *= 1000;
+	return 0;
+}
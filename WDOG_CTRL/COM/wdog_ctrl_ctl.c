@@ -0,0 +1,634 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_CTL                     ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_ctl.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Control socket of a running trigger loop (-C)
+ *
+ *               A control thread listens on a unix socket and reads one
+ *               command per line:
+ *
+ *                 max <ms>          set max. time (WDOG_TIME_MAX/WDOG_TIME)
+ *                 min <ms>          set min. time (WDOG_TIME_MIN)
+ *                 irq <ms>          set irq time (WDOG_TIME_IRQ)
+ *                 period <ms>       set trigger period
+ *                 pattern <0|1>     trigger with alternating pattern
+ *                 verbose <0|1>     verbose output
+ *                 info              read all supported status codes
+ *
+ *               Each command is answered with one line:
+ *
+ *                 ok at=<us> pass=<n> [<code>=<value> ...]
+ *                 err <reason>
+ *
+ *               with the CLOCK_MONOTONIC time the trigger loop applied
+ *               the command and the last pass before.
+ *
+ *               The control thread puts commands into a lock-free single
+ *               producer/single consumer ring and wakes the trigger loop.
+ *               The loop applies them between passes and puts the replies
+ *               into a second ring, the control thread sends them. The
+ *               loop never touches a client socket. A client that sends
+ *               too long lines or doesn't take its replies at once is
+ *               disconnected, a full command ring is answered "err busy".
+ *
+ *               The socket is private like the handover socket (mode
+ *               0600, safe directory, see HoSockListen()), clients of
+ *               other users are refused.
+ *
+ *               max and period keep CTL_MARGIN percent of the max. time
+ *               between period and max. time. With -a, max is refused,
+ *               the auto period depends on the max. time it started with.
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef LINUX
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <signal.h>
+#	include <unistd.h>
+#	include <sys/socket.h>
+#	include <sys/un.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+#ifdef LINUX
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define CTL_CLIENTS		4		/**< max. connected clients */
+#define CTL_LINE		64		/**< max. command line length */
+#define CTL_MARGIN		10		/**< min. margin period - max. time [%] */
+
+/*--------------------------------------+
+|   TYPDEFS                             |
++--------------------------------------*/
+/** connected client */
+typedef struct {
+	int		fd;			/**< -1 = free */
+	u_int32	id;			/**< slot and generation */
+	int		len;		/**< bytes in line */
+	char	line[CTL_LINE];
+} CTL_CLIENT;
+
+/** command names, index = CTL_xxx - 1 */
+static const char *G_ctlName[] = {
+	"max", "min", "irq", "period", "pattern", "verbose", "info"
+};
+
+/***************************************************************************/
+/** Put command into ring (control thread)
+ *
+ *  \param ctl        \INOUT control socket
+ *  \param cmd        \IN  command
+ *
+ *  \return           0 or -1 if ring full
+ */
+static int CtlPushCmd(WDOG_CTL *ctl, const CTL_CMD *cmd)
+{
+	if (ctl->cmdHead - ctl->cmdTail == CTL_QLEN)
+		return -1;
+	ctl->cmd[ctl->cmdHead % CTL_QLEN] = *cmd;
+	__sync_synchronize();
+	ctl->cmdHead++;
+	return 0;
+}
+
+/***************************************************************************/
+/** Put reply into ring and notify control thread (trigger loop)
+ *
+ *  Never blocks: a reply that doesn't fit is dropped.
+ *
+ *  \param ctl        \INOUT control socket
+ *  \param client     \IN  client id
+ *  \param text       \IN  reply without newline
+ */
+static void CtlPushRep(WDOG_CTL *ctl, u_int32 client, const char *text)
+{
+	CTL_REP *rep;
+	ssize_t n;
+
+	if (ctl->repHead - ctl->repTail == CTL_QLEN) {
+		ctl->dropped++;
+		return;
+	}
+	rep = &ctl->rep[ctl->repHead % CTL_QLEN];
+	rep->client = client;
+	snprintf(rep->text, sizeof(rep->text), "%s\n", text);
+	__sync_synchronize();
+	ctl->repHead++;
+
+	/* pipe full: notification is pending anyway */
+	n = write(ctl->notifyWr, "", 1);
+	(void)n;
+}
+
+/***************************************************************************/
+/** Close client
+ *
+ *  \param cl         \INOUT client
+ */
+static void CtlDrop(CTL_CLIENT *cl)
+{
+	close(cl->fd);
+	cl->fd = -1;
+}
+
+/***************************************************************************/
+/** Send line to client, drop client if it doesn't take it at once
+ *
+ *  \param cl         \INOUT client
+ *  \param text       \IN  line with newline
+ */
+static void CtlSend(CTL_CLIENT *cl, const char *text)
+{
+	size_t len = strlen(text);
+
+	if (send(cl->fd, text, len, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)len)
+		CtlDrop(cl);
+}
+
+/***************************************************************************/
+/** Parse command line, queue command or answer error (control thread)
+ *
+ *  \param ctl        \INOUT control socket
+ *  \param cl         \INOUT client
+ *  \param line       \IN  line without newline
+ */
+static void CtlParse(WDOG_CTL *ctl, CTL_CLIENT *cl, char *line)
+{
+	CTL_CMD cmd;
+	char *name, *arg, *end, *save = NULL;
+	int i;
+
+	if (!(name = strtok_r(line, " \t\r", &save)))
+		return;
+	arg = strtok_r(NULL, " \t\r", &save);
+
+	for (i = 0; i < CTL_INFO; i++)
+		if (!strcmp(name, G_ctlName[i]))
+			break;
+	if (i == CTL_INFO) {
+		CtlSend(cl, "err unknown command\n");
+		return;
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.op = i + 1;
+	cmd.client = cl->id;
+	if (cmd.op != CTL_INFO) {
+		if (!arg || ((cmd.arg = (int32)strtol(arg, &end, 0)), *end) ||
+			(cmd.arg < 0)) {
+			CtlSend(cl, "err bad value\n");
+			return;
+		}
+	}
+
+	if (CtlPushCmd(ctl, &cmd) < 0) {
+		CtlSend(cl, "err busy\n");
+		return;
+	}
+	EvtWake(ctl->evt);
+}
+
+/***************************************************************************/
+/** Control thread: accept clients, read commands, send replies
+ *
+ *  \param arg        \IN  control socket
+ *
+ *  \return           NULL
+ */
+static void *CtlThread(void *arg)
+{
+	WDOG_CTL *ctl = (WDOG_CTL*)arg;
+	CTL_CLIENT cl[CTL_CLIENTS];
+	struct pollfd pfd[CTL_CLIENTS + 2];
+	CTL_REP *rep;
+	char buf[16], *nl;
+	u_int32 gen = 0;
+	int i, fd, n;
+
+	for (i = 0; i < CTL_CLIENTS; i++)
+		cl[i].fd = -1;
+
+	while (!ctl->stop) {
+		pfd[0].fd = ctl->notifyRd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = ctl->lfd;
+		pfd[1].events = POLLIN;
+		for (i = 0; i < CTL_CLIENTS; i++) {
+			pfd[i + 2].fd = cl[i].fd;
+			pfd[i + 2].events = POLLIN;
+		}
+		if (poll(pfd, CTL_CLIENTS + 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		/* replies from trigger loop */
+		if (pfd[0].revents) {
+			while (read(ctl->notifyRd, buf, sizeof(buf)) > 0)
+				;
+			while (ctl->repTail != ctl->repHead) {
+				__sync_synchronize();
+				rep = &ctl->rep[ctl->repTail % CTL_QLEN];
+				i = rep->client % CTL_CLIENTS;
+				if ((cl[i].fd >= 0) && (cl[i].id == rep->client))
+					CtlSend(&cl[i], rep->text);
+				__sync_synchronize();
+				ctl->repTail++;
+			}
+		}
+
+		/* new client */
+		if (pfd[1].revents &&
+			((fd = accept(ctl->lfd, NULL, NULL)) >= 0)) {
+			for (i = 0; (i < CTL_CLIENTS) && (cl[i].fd >= 0); i++)
+				;
+			if (HoSockPeer(fd) < 0)
+				close(fd);
+			else if (i == CTL_CLIENTS) {
+				send(fd, "err too many clients\n", 21, MSG_DONTWAIT | MSG_NOSIGNAL);
+				close(fd);
+			}
+			else {
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+				cl[i].fd = fd;
+				cl[i].id = (++gen * CTL_CLIENTS) + i;
+				cl[i].len = 0;
+			}
+		}
+
+		/* commands */
+		for (i = 0; i < CTL_CLIENTS; i++) {
+			if ((cl[i].fd < 0) || (pfd[i + 2].fd != cl[i].fd) ||
+				!pfd[i + 2].revents)
+				continue;
+			n = recv(cl[i].fd, cl[i].line + cl[i].len,
+					 CTL_LINE - 1 - cl[i].len, MSG_DONTWAIT);
+			if (n <= 0) {
+				if ((n == 0) || (errno != EAGAIN))
+					CtlDrop(&cl[i]);
+				continue;
+			}
+			cl[i].len += n;
+			cl[i].line[cl[i].len] = '\0';
+			while ((cl[i].fd >= 0) && (nl = strchr(cl[i].line, '\n'))) {
+				*nl++ = '\0';
+				CtlParse(ctl, &cl[i], cl[i].line);
+				cl[i].len -= nl - cl[i].line;
+				memmove(cl[i].line, nl, cl[i].len + 1);
+			}
+			if ((cl[i].fd >= 0) && (cl[i].len == CTL_LINE - 1)) {
+				CtlSend(&cl[i], "err line too long\n");
+				if (cl[i].fd >= 0)
+					CtlDrop(&cl[i]);
+			}
+		}
+	}
+
+	for (i = 0; i < CTL_CLIENTS; i++)
+		if (cl[i].fd >= 0)
+			CtlDrop(&cl[i]);
+	return NULL;
+}
+
+/***************************************************************************/
+/** Check control socket path
+ *
+ *  \param ctl        \OUT control socket
+ *  \param path       \IN  socket path
+ *
+ *  \return           success (0) or error code
+ */
+int CtlInit(WDOG_CTL *ctl, const char *path)
+{
+	struct sockaddr_un addr;
+
+	memset(ctl, 0, sizeof(*ctl));
+	ctl->lfd = ctl->notifyRd = ctl->notifyWr = -1;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("*** control socket path too long\n");
+		return ERR_PARAM;
+	}
+	ctl->path = path;
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Listen on control socket, start control thread
+ *
+ *  \param ctl        \INOUT control socket
+ *  \param evt        \IN  event loop to wake, EvtWakeInit() done
+ *
+ *  \return           success (0) or error code
+ */
+int CtlStart(WDOG_CTL *ctl, WDOG_EVT *evt)
+{
+	sigset_t mask, oldMask;
+	int fd[2], err;
+
+	ctl->evt = evt;
+
+	/* replaces a stale socket or the one of the instance we take over from */
+	if ((ctl->lfd = HoSockListen(ctl->path, CTL_CLIENTS, "control")) < 0)
+		return ERR_FUNC;
+
+	if (pipe(fd) < 0) {
+		perror("*** can't create control pipe");
+		CtlExit(ctl, 1);
+		return ERR_FUNC;
+	}
+	fcntl(fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(fd[1], F_SETFL, O_NONBLOCK);
+	fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+	ctl->notifyRd = fd[0];
+	ctl->notifyWr = fd[1];
+
+	/* signals (SIGTERM, irq signal) stay with the trigger thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &oldMask);
+	err = pthread_create(&ctl->thr, NULL, CtlThread, ctl);
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+	if (err != 0) {
+		printf("*** can't create control thread: %s\n", strerror(err));
+		CtlExit(ctl, 1);
+		return ERR_FUNC;
+	}
+	ctl->running = 1;
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Read supported status codes for info reply
+ *
+ *  \param buf        \OUT text
+ *  \param size       \IN  size of buf
+ */
+static void CtlInfo(char *buf, size_t size)
+{
+	size_t len = strlen(buf);
+	int32 val;
+	int i;
+
+	for (i = 0; (i < WDOG_CODES) && (len < size); i++) {
+		if (!CapHas(G_wdogCode[i].code, 0) ||
+			(M_getstat(G_path, G_wdogCode[i].code, &val) < 0))
+			continue;
+		len += snprintf(buf + len, size - len, " %s=%d",
+						G_wdogCode[i].name, val);
+	}
+}
+
+/***************************************************************************/
+/** Apply one command
+ *
+ *  \param lp         \INOUT loop state
+ *  \param cmd        \IN  command
+ *  \param err        \OUT reason if not applied
+ *
+ *  \return           1 if trigger period changed, 0 if not, -1 on error
+ */
+static int CtlDo(WDOG_LOOP *lp, const CTL_CMD *cmd, const char **err)
+{
+	int32 maxT, minT, irqT, pat;
+
+	switch (cmd->op) {
+	case CTL_MAX:
+		if (lp->autoPct != -1) {
+			*err = "max. time is the base of -a";
+			return -1;
+		}
+		if (cmd->arg && ((u_int64)lp->trigT * 100 >
+						 (u_int64)cmd->arg * (100 - CTL_MARGIN))) {
+			*err = "max. time must exceed the period plus margin";
+			return -1;
+		}
+		if ((!CapHas(WDOG_TIME_MAX, 1) ||
+			 (M_setstat(G_path, WDOG_TIME_MAX, cmd->arg * 1000) < 0)) &&
+			(M_setstat(G_path, WDOG_TIME, cmd->arg) < 0))
+			goto SETSTAT;
+		break;
+
+	case CTL_MIN:
+		if (cmd->arg >= lp->trigT) {
+			*err = "min. time must be below the period";
+			return -1;
+		}
+		if (M_setstat(G_path, WDOG_TIME_MIN, cmd->arg * 1000) < 0)
+			goto SETSTAT;
+		break;
+
+	case CTL_IRQ:
+		if (lp->irqDrive && (!cmd->arg || (cmd->arg >= lp->trigT))) {
+			*err = "-Q needs 0 < irq time < period";
+			return -1;
+		}
+		if (M_setstat(G_path, WDOG_TIME_IRQ, cmd->arg * 1000) < 0)
+			goto SETSTAT;
+		break;
+
+	case CTL_PERIOD:
+		if (lp->autoPct != -1) {
+			*err = "period is set by -a";
+			return -1;
+		}
+		if (cmd->arg <= 0) {
+			*err = "period must be > 0";
+			return -1;
+		}
+		if ((CapMaxTime(&maxT) == 0) && (maxT > 0) &&
+			((u_int64)cmd->arg * 100000 > (u_int64)maxT * (100 - CTL_MARGIN))) {
+			*err = "period plus margin must be below the max. time";
+			return -1;
+		}
+		if (CapHas(WDOG_TIME_MIN, 0) &&
+			(M_getstat(G_path, WDOG_TIME_MIN, &minT) == 0) &&
+			(cmd->arg * 1000 <= minT)) {
+			*err = "period must exceed the min. time";
+			return -1;
+		}
+		if (lp->irqDrive &&
+			(M_getstat(G_path, WDOG_TIME_IRQ, &irqT) == 0) &&
+			(cmd->arg * 1000 <= irqT)) {
+			*err = "-Q needs period > irq time";
+			return -1;
+		}
+		printf("Control: period %dms -> %dms\n", lp->trigT, cmd->arg);
+		lp->trigT = cmd->arg;
+		return 1;
+
+	case CTL_PATTERN:
+		/* continue with the pattern not used last */
+		if (cmd->arg && !lp->usePat) {
+			if (M_getstat(G_path, WDOG_TRIG_PAT, &pat) < 0) {
+				*err = M_errstring(UOS_ErrnoGet());
+				return -1;
+			}
+			lp->patIdx = (pat == WDOG_TRIGPAT(0)) ? 1 : 0;
+		}
+		lp->usePat = cmd->arg ? 1 : 0;
+		if (lp->flt)
+			lp->flt->usePat = lp->usePat;
+		break;
+
+	case CTL_VERBOSE:
+		lp->verbose = cmd->arg ? 1 : 0;
+		break;
+	}
+	return 0;
+
+SETSTAT:
+	*err = M_errstring(UOS_ErrnoGet());
+	return -1;
+}
+
+/***************************************************************************/
+/** Apply queued commands (trigger loop, between passes)
+ *
+ *  \param ctl        \INOUT control socket
+ *  \param lp         \INOUT loop state
+ *
+ *  \return           1 if trigger period changed, else 0
+ */
+int CtlApply(WDOG_CTL *ctl, WDOG_LOOP *lp)
+{
+	CTL_CMD cmd;
+	const char *err = NULL;
+	char text[CTL_TEXT];
+	int changed = 0, n;
+
+	while (ctl->cmdTail != ctl->cmdHead) {
+		__sync_synchronize();
+		cmd = ctl->cmd[ctl->cmdTail % CTL_QLEN];
+		__sync_synchronize();
+		ctl->cmdTail++;
+
+		if ((n = CtlDo(lp, &cmd, &err)) < 0) {
+			snprintf(text, sizeof(text), "err %s", err);
+		}
+		else {
+			changed |= n;
+			snprintf(text, sizeof(text), "ok at=%lluus pass=%u",
+					 (unsigned long long)NowUs(), lp->count);
+			if (cmd.op == CTL_INFO)
+				CtlInfo(text, sizeof(text));
+		}
+		if (lp->verbose)
+			printf("Control: %s %d: %s\n", G_ctlName[cmd.op - 1], cmd.arg, text);
+		CtlPushRep(ctl, cmd.client, text);
+	}
+	return changed;
+}
+
+/***************************************************************************/
+/** Stop control thread, close socket
+ *
+ *  \param ctl        \INOUT control socket
+ *  \param unlinkPath \IN  remove socket file (not after handover)
+ */
+void CtlExit(WDOG_CTL *ctl, int unlinkPath)
+{
+	ssize_t n;
+
+	if (ctl->running) {
+		ctl->stop = 1;
+		n = write(ctl->notifyWr, "", 1);
+		(void)n;
+		pthread_join(ctl->thr, NULL);
+		ctl->running = 0;
+		if (ctl->dropped)
+			printf("*** control: %u replies dropped\n", ctl->dropped);
+	}
+	if (ctl->notifyRd >= 0) {
+		close(ctl->notifyRd);
+		close(ctl->notifyWr);
+		ctl->notifyRd = ctl->notifyWr = -1;
+	}
+	if (ctl->lfd >= 0) {
+		close(ctl->lfd);
+		ctl->lfd = -1;
+		if (unlinkPath)
+			unlink(ctl->path);
+	}
+}
+
+#else /* !LINUX */
+
+/***************************************************************************/
+/** Check control socket path - not supported
+ *
+ *  \return           ERR_FUNC
+ */
+int CtlInit(WDOG_CTL *ctl, const char *path)
+{
+	printf("*** -C not supported on this system\n");
+	return ERR_FUNC;
+}
+
+/***************************************************************************/
+/** Start control thread - not supported
+ *
+ *  \return           ERR_FUNC
+ */
+int CtlStart(WDOG_CTL *ctl, WDOG_EVT *evt)
+{
+	return ERR_FUNC;
+}
+
+/***************************************************************************/
+/** Apply queued commands - not supported
+ *
+ *  \return           0
+ */
+int CtlApply(WDOG_CTL *ctl, WDOG_LOOP *lp)
+{
+	return 0;
+}
+
+/***************************************************************************/
+/** Stop control thread - not supported
+ */
+void CtlExit(WDOG_CTL *ctl, int unlinkPath)
+{
+}
+
+#endif /* LINUX */
@@ -0,0 +1,460 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_EVT                     ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_evt.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Event loop of the WDOG_CTRL trigger loop
+ *
+ *               The trigger loop waits at one single point for the next
+ *               trigger deadline, a keypress or a termination request.
+ *               On Linux this is one epoll_wait() on a timerfd, stdin
+ *               and a signalfd for SIGTERM/SIGINT, so a keypress or
+ *               signal ends the wait immediately. Other systems fall
+ *               back to UOS_Delay() and UOS_KeyPressed().
+ *
+ *               A signal handler can end the wait with EvtWake(), which
+ *               writes to a pipe (self-pipe), as only few functions may
+ *               be called from a signal handler.
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#ifdef LINUX
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <time.h>
+#	include <unistd.h>
+#	include <sys/epoll.h>
+#	include <sys/timerfd.h>
+#	include <sys/signalfd.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include "wdog_ctrl_int.h"
+
+#ifdef LINUX
+
+/***************************************************************************/
+/** Get monotonic time
+ *
+ *  \return           monotonic time [us]
+ */
+u_int64 NowUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/***************************************************************************/
+/** Add fd to epoll instance
+ *
+ *  \param evt        \IN  event loop
+ *  \param fd         \IN  file descriptor to watch for input
+ *
+ *  \return           0 or -1 on error
+ */
+static int EvtAdd(WDOG_EVT *evt, int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return epoll_ctl(evt->epFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/***************************************************************************/
+/** Watch additional fd for input
+ *
+ *  EvtWait() returns EVT_FD with evt->fd set when it is readable.
+ *
+ *  \param evt        \IN  event loop
+ *  \param fd         \IN  file descriptor
+ *
+ *  \return           success (0) or error code
+ */
+int EvtWatch(WDOG_EVT *evt, int fd)
+{
+	if (EvtAdd(evt, fd) < 0) {
+		perror("*** can't watch fd");
+		return ERR_FUNC;
+	}
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Stop watching fd
+ *
+ *  \param evt        \IN  event loop
+ *  \param fd         \IN  file descriptor
+ */
+void EvtUnwatch(WDOG_EVT *evt, int fd)
+{
+	epoll_ctl(evt->epFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/***************************************************************************/
+/** Create wake pipe for EvtWake()
+ *
+ *  \param evt        \IN  event loop
+ *
+ *  \return           success (0) or error code
+ */
+int EvtWakeInit(WDOG_EVT *evt)
+{
+	int fd[2];
+
+	if (pipe(fd) < 0) {
+		perror("*** can't create wake pipe");
+		return ERR_FUNC;
+	}
+	fcntl(fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(fd[1], F_SETFL, O_NONBLOCK);
+	fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+	evt->wakeRd = fd[0];
+	evt->wakeWr = fd[1];
+
+	if (EvtAdd(evt, evt->wakeRd) < 0) {
+		perror("*** can't watch wake pipe");
+		return ERR_FUNC;
+	}
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** End wait with EVT_WAKE, async-signal-safe
+ *
+ *  \param evt        \IN  event loop
+ */
+void EvtWake(WDOG_EVT *evt)
+{
+	int err = errno;
+	ssize_t n;
+
+	/* pipe full: wakeup is pending anyway */
+	n = write(evt->wakeWr, "", 1);
+	(void)n;
+	errno = err;
+}
+
+/***************************************************************************/
+/** Initialize event loop
+ *
+ *  Blocks SIGTERM/SIGINT (delivered via signalfd instead) and switches
+ *  a terminal on stdin to non-canonical mode, so that any single key
+ *  ends the wait.
+ *
+ *  \param evt        \OUT event loop
+ *
+ *  \return           success (0) or error code
+ */
+int EvtInit(WDOG_EVT *evt)
+{
+	struct termios tio;
+	sigset_t mask;
+
+	memset(evt, 0, sizeof(*evt));
+	evt->epFd = evt->tmrFd = evt->sigFd = evt->keyFd = -1;
+	evt->wakeRd = evt->wakeWr = -1;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	if (sigprocmask(SIG_BLOCK, &mask, &evt->sigMask) < 0) {
+		perror("*** can't block signals");
+		return ERR_FUNC;
+	}
+
+	if (((evt->epFd = epoll_create1(EPOLL_CLOEXEC)) < 0) ||
+		((evt->tmrFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0) ||
+		((evt->sigFd = signalfd(-1, &mask, SFD_CLOEXEC)) < 0) ||
+		(EvtAdd(evt, evt->tmrFd) < 0) ||
+		(EvtAdd(evt, evt->sigFd) < 0)) {
+		perror("*** can't init event loop");
+		EvtExit(evt);
+		return ERR_FUNC;
+	}
+
+	/* watch stdin only for a terminal (scripts may run us with </dev/null) */
+	if (isatty(STDIN_FILENO) && (tcgetattr(STDIN_FILENO, &evt->tio) == 0)) {
+		tio = evt->tio;
+		tio.c_lflag &= ~(ICANON | ECHO);
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+		evt->keyFd = STDIN_FILENO;
+		if (EvtAdd(evt, evt->keyFd) < 0) {
+			perror("*** can't init event loop");
+			EvtExit(evt);
+			return ERR_FUNC;
+		}
+	}
+
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Arm timer
+ *
+ *  A periodic timer keeps running without being re-armed each pass.
+ *
+ *  \param evt        \IN  event loop
+ *  \param deadline   \IN  first expiry [us, monotonic]
+ *  \param period     \IN  period [us], 0=one-shot
+ */
+void EvtArm(WDOG_EVT *evt, u_int64 deadline, u_int32 period)
+{
+	struct itimerspec its;
+
+	evt->deadline = evt->next = deadline;
+	evt->period = period;
+
+	its.it_value.tv_sec = deadline / 1000000;
+	its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+	its.it_interval.tv_sec = period / 1000000;
+	its.it_interval.tv_nsec = (period % 1000000) * 1000;
+	timerfd_settime(evt->tmrFd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/***************************************************************************/
+/** Wait for next event
+ *
+ *  Termination takes precedence over a keypress, a keypress over the
+ *  timer, so that a pending stop request is never delayed by a trigger.
+ *  Wakeups and watched fds come last; they stay pending and are
+ *  reported by one of the next calls.
+ *
+ *  On EVT_TIMER, evt->deadline is the expiry that ended the wait.
+ *  On EVT_FD, evt->fd is the readable fd.
+ *
+ *  \param evt        \IN  event loop
+ *
+ *  \return           EVT_TIMER, EVT_KEY, EVT_TERM, EVT_WAKE, EVT_FD or EVT_ERR
+ */
+int EvtWait(WDOG_EVT *evt)
+{
+	struct epoll_event ev[EVT_MAX_FDS];
+	struct signalfd_siginfo si;
+	u_int64 exp;
+	char key, buf[16];
+	int n, i, term, keyHit, tmr, wake, fd;
+
+	for (;;) {
+		n = epoll_wait(evt->epFd, ev, EVT_MAX_FDS, -1);
+		if (n < 0) {
+			/* e.g. UOS_SIG_USR1 of the wdog irq */
+			if (errno == EINTR)
+				continue;
+			perror("*** epoll_wait");
+			return EVT_ERR;
+		}
+
+		term = keyHit = tmr = wake = 0;
+		fd = -1;
+		for (i = 0; i < n; i++) {
+			if (ev[i].data.fd == evt->sigFd)
+				term = (read(evt->sigFd, &si, sizeof(si)) == sizeof(si));
+			else if (ev[i].data.fd == evt->keyFd) {
+				if (read(evt->keyFd, &key, 1) == 1)
+					keyHit = 1;
+				else {
+					/* EOF: stop watching stdin */
+					epoll_ctl(evt->epFd, EPOLL_CTL_DEL, evt->keyFd, NULL);
+					evt->keyFd = -1;
+				}
+			}
+			else if (ev[i].data.fd == evt->tmrFd) {
+				if (read(evt->tmrFd, &exp, sizeof(exp)) == sizeof(exp)) {
+					tmr = 1;
+					evt->overrun += (u_int32)(exp - 1);
+					evt->deadline = evt->next + (u_int64)evt->period * (exp - 1);
+					evt->next = evt->deadline + evt->period;
+				}
+			}
+			else if (ev[i].data.fd == evt->wakeRd)
+				wake = 1;
+			else
+				fd = ev[i].data.fd;
+		}
+
+		if (term)
+			return EVT_TERM;
+		if (keyHit)
+			return EVT_KEY;
+		if (tmr)
+			return EVT_TIMER;
+		if (wake) {
+			while (read(evt->wakeRd, buf, sizeof(buf)) > 0)
+				;
+			return EVT_WAKE;
+		}
+		if (fd >= 0) {
+			evt->fd = fd;
+			return EVT_FD;
+		}
+	}
+}
+
+/***************************************************************************/
+/** Release event loop and restore terminal and signal mask
+ *
+ *  \param evt        \IN  event loop
+ */
+void EvtExit(WDOG_EVT *evt)
+{
+	if (evt->keyFd >= 0)
+		tcsetattr(evt->keyFd, TCSANOW, &evt->tio);
+	if (evt->sigFd >= 0)
+		close(evt->sigFd);
+	if (evt->tmrFd >= 0)
+		close(evt->tmrFd);
+	if (evt->epFd >= 0)
+		close(evt->epFd);
+	if (evt->wakeRd >= 0) {
+		close(evt->wakeRd);
+		close(evt->wakeWr);
+	}
+	evt->epFd = evt->tmrFd = evt->sigFd = evt->keyFd = -1;
+	evt->wakeRd = evt->wakeWr = -1;
+
+	sigprocmask(SIG_SETMASK, &evt->sigMask, NULL);
+}
+
+#else /* !LINUX */
+
+/***************************************************************************/
+/** Get monotonic time
+ *
+ *  \return           monotonic time [us]
+ */
+u_int64 NowUs(void)
+{
+	return (u_int64)UOS_MsecTimerGet() * 1000;
+}
+
+/***************************************************************************/
+/** Initialize event loop
+ *
+ *  \param evt        \OUT event loop
+ *
+ *  \return           success (0)
+ */
+int EvtInit(WDOG_EVT *evt)
+{
+	memset(evt, 0, sizeof(*evt));
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Arm timer
+ *
+ *  \param evt        \IN  event loop
+ *  \param deadline   \IN  first expiry [us]
+ *  \param period     \IN  period [us], 0=one-shot
+ */
+void EvtArm(WDOG_EVT *evt, u_int64 deadline, u_int32 period)
+{
+	evt->deadline = evt->next = deadline;
+	evt->period = period;
+}
+
+/***************************************************************************/
+/** Wait for next event
+ *
+ *  A key pressed during the previous pass is reported before sleeping.
+ *
+ *  \param evt        \IN  event loop
+ *
+ *  \return           EVT_TIMER or EVT_KEY
+ */
+int EvtWait(WDOG_EVT *evt)
+{
+	u_int64 now;
+
+	if (UOS_KeyPressed() != -1)
+		return EVT_KEY;
+
+	now = NowUs();
+	if (evt->next > now)
+		UOS_Delay((u_int32)((evt->next - now + 999) / 1000));
+
+	evt->deadline = evt->next;
+	evt->next += evt->period;
+	return EVT_TIMER;
+}
+
+/***************************************************************************/
+/** Watch additional fd for input - not supported
+ *
+ *  \return           ERR_FUNC
+ */
+int EvtWatch(WDOG_EVT *evt, int fd)
+{
+	return ERR_FUNC;
+}
+
+/***************************************************************************/
+/** Stop watching fd - not supported
+ */
+void EvtUnwatch(WDOG_EVT *evt, int fd)
+{
+}
+
+/***************************************************************************/
+/** Create wake pipe - not supported
+ *
+ *  \return           ERR_FUNC
+ */
+int EvtWakeInit(WDOG_EVT *evt)
+{
+	return ERR_FUNC;
+}
+
+/***************************************************************************/
+/** End wait - not supported
+ */
+void EvtWake(WDOG_EVT *evt)
+{
+}
+
+/***************************************************************************/
+/** Release event loop
+ *
+ *  \param evt        \IN  event loop
+ */
+void EvtExit(WDOG_EVT *evt)
+{
+}
+
+#endif /* LINUX */
@@ -0,0 +1,261 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_FAULT                   ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_fault.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Fault injection for the WDOG_CTRL trigger loop (-x/-X)
+ *
+ *               Faults are either drawn from a seeded pseudo random
+ *               generator (same seed = same faults) or read from a
+ *               script file. After each pass with an injected fault or
+ *               a changed reason code, one log line is printed with the
+ *               fault and WDOG_OUT_REASON/WDOG_IRQ_REASON read back.
+ *               Reported reasons are cleared and the watchdog is reset
+ *               (WDOG_RESET_CTRL), so the next scenario can follow.
+ *
+ *               Script format, one fault per line, '#' starts a comment:
+ *                 <pass> delay <ms>   trigger <ms> late
+ *                 <pass> skip         omit the trigger
+ *                 <pass> badpat       repeat last pattern (-P only)
+ *                 <pass> burst <n>    trigger n times back-to-back
+ *
+ *    \switches  (none)
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+/*--------------------------------------+
+|   GLOBALS                             |
++--------------------------------------*/
+static const char *G_faultName[] = { "-", "delay", "skip", "badpat", "burst" };
+
+/***************************************************************************/
+/** Get next pseudo random number (xorshift64*)
+ *
+ *  Own generator to get the same fault sequence for a seed everywhere.
+ *
+ *  \param flt        \INOUT fault injection
+ *
+ *  \return           random number
+ */
+static u_int32 FaultRand(WDOG_FAULT *flt)
+{
+	flt->rng ^= flt->rng >> 12;
+	flt->rng ^= flt->rng << 25;
+	flt->rng ^= flt->rng >> 27;
+	return (u_int32)((flt->rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/***************************************************************************/
+/** Load fault script
+ *
+ *  \param flt        \INOUT fault injection
+ *  \param file       \IN  script file
+ *
+ *  \return           success (0) or error code
+ */
+static int FaultLoad(WDOG_FAULT *flt, const char *file)
+{
+	FILE *fp;
+	char line[128], kind[16];
+	int32 pass, arg, lineNbr = 0, k;
+	int n, alloc = 0;
+	WDOG_FAULT_EV *ev;
+
+	if (!(fp = fopen(file, "r"))) {
+		printf("*** can't open fault script %s\n", file);
+		return ERR_PARAM;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineNbr++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = '\0';
+
+		arg = 0;
+		if ((n = sscanf(line, "%d %15s %d", &pass, kind, &arg)) <= 0)
+			continue;
+
+		for (k = FAULT_DELAY; k <= FAULT_BURST; k++)
+			if (!strcmp(kind, G_faultName[k]))
+				break;
+
+		if ((n < 2) || (pass < 1) || (k > FAULT_BURST) ||
+			((k == FAULT_DELAY || k == FAULT_BURST) && (n < 3 || arg < 1)) ||
+			((k == FAULT_BADPAT) && !flt->usePat) ||
+			(flt->nScript && pass <= flt->script[flt->nScript-1].pass)) {
+			printf("*** %s line %d: illegal or unordered fault\n", file, lineNbr);
+			fclose(fp);
+			return ERR_PARAM;
+		}
+
+		if (flt->nScript == alloc) {
+			alloc = alloc ? alloc * 2 : 32;
+			if (!(ev = realloc(flt->script, alloc * sizeof(*ev)))) {
+				printf("*** out of memory\n");
+				fclose(fp);
+				return ERR_FUNC;
+			}
+			flt->script = ev;
+		}
+		ev = &flt->script[flt->nScript++];
+		ev->pass = pass;
+		ev->kind = k;
+		ev->arg  = arg;
+	}
+
+	fclose(fp);
+
+	/* no steps: don't fall back to random faults */
+	if (!flt->nScript) {
+		printf("*** fault script %s contains no faults\n", file);
+		return ERR_PARAM;
+	}
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Initialize fault injection
+ *
+ *  \param flt        \OUT fault injection
+ *  \param script     \IN  script file or NULL for random faults
+ *  \param seed       \IN  seed for random faults
+ *  \param pct        \IN  probability of a fault per pass [%]
+ *  \param usePat     \IN  loop triggers with pattern
+ *
+ *  \return           success (0) or error code
+ */
+int FaultInit(WDOG_FAULT *flt, const char *script, u_int32 seed, int32 pct,
+			  int32 usePat)
+{
+	memset(flt, 0, sizeof(*flt));
+	flt->pct = pct;
+	flt->usePat = usePat;
+	flt->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+
+	if (script)
+		return FaultLoad(flt, script);
+
+	printf("Fault injection: seed %u, %d%% of passes\n", seed, pct);
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Get fault to inject at this pass
+ *
+ *  \param flt        \INOUT fault injection
+ *  \param pass       \IN  pass number (1..n)
+ *  \param trigT      \IN  current trigger period [ms]
+ *  \param ev         \OUT fault (kind FAULT_NONE if none)
+ *
+ *  \return           fault kind
+ */
+int FaultNext(WDOG_FAULT *flt, u_int32 pass, int32 trigT, WDOG_FAULT_EV *ev)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->pass = pass;
+
+	if (flt->script) {
+		if ((flt->next < flt->nScript) &&
+			(flt->script[flt->next].pass == (int32)pass))
+			*ev = flt->script[flt->next++];
+	}
+	else if ((int32)(FaultRand(flt) % 100) < flt->pct) {
+		/* badpat only makes sense when triggering with pattern */
+		ev->kind = FAULT_DELAY + FaultRand(flt) % (flt->usePat ? 4 : 3);
+		if (!flt->usePat && ev->kind == FAULT_BADPAT)
+			ev->kind = FAULT_BURST;
+
+		switch (ev->kind) {
+		case FAULT_DELAY:
+			/* up to twice the period, to hit both sides of the limit */
+			ev->arg = 1 + FaultRand(flt) % (2 * (trigT > 0 ? trigT : 1));
+			break;
+		case FAULT_BURST:
+			ev->arg = 2 + FaultRand(flt) % 4;
+			break;
+		}
+	}
+
+	if (ev->kind != FAULT_NONE)
+		flt->injected++;
+	return ev->kind;
+}
+
+/***************************************************************************/
+/** Read back reasons, log fault/reason change, reset watchdog if fired
+ *
+ *  \param flt        \INOUT fault injection
+ *  \param ev         \IN  fault injected in this pass
+ */
+void FaultLog(WDOG_FAULT *flt, WDOG_FAULT_EV *ev)
+{
+	int32 outR = -1, irqR = -1;
+	u_int64 t = NowUs() - flt->start;
+
+	M_getstat(G_path, WDOG_OUT_REASON, &outR);
+	M_getstat(G_path, WDOG_IRQ_REASON, &irqR);
+
+	if ((ev->kind == FAULT_NONE) && !outR && !irqR)
+		return;
+
+	printf("FAULT #%06d +%llu.%03llums %-6s %5d -> out_reason=%d irq_reason=%d",
+		ev->pass, (unsigned long long)(t / 1000), (unsigned long long)(t % 1000),
+		G_faultName[ev->kind], ev->arg, outR, irqR);
+
+	if (outR > 0 || irqR > 0) {
+		flt->fired++;
+		M_setstat(G_path, WDOG_OUT_REASON, 0);
+		M_setstat(G_path, WDOG_IRQ_REASON, 0);
+		if (M_setstat(G_path, WDOG_RESET_CTRL, 0) < 0)
+			printf(" (reset failed: %s)", M_errstring(UOS_ErrnoGet()));
+		else
+			printf(" (reset)");
+	}
+	printf("\n");
+}
+
+/***************************************************************************/
+/** Print summary and release fault injection
+ *
+ *  \param flt        \IN  fault injection
+ */
+void FaultExit(WDOG_FAULT *flt)
+{
+	printf("Fault injection: %u faults injected, watchdog fired %u times\n",
+		flt->injected, flt->fired);
+	free(flt->script);
+	flt->script = NULL;
+}
@@ -0,0 +1,421 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_GATE                    ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_gate.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Health gate of the trigger loop (-G)
+ *
+ *               A probe thread checks the system pressure (PSI) and
+ *               liveness probes each interval and publishes one verdict:
+ *               gate open, or the probe that closed it. A probe closes
+ *               the gate when it is bad for the hold time without
+ *               interruption. While the gate is closed, the trigger loop
+ *               doesn't trigger, so the watchdog resets a board that is
+ *               alive but thrashing. If the probes recover before the
+ *               watchdog expires, triggering resumes.
+ *
+ *               All probe files are opened once and read with pread(),
+ *               the trigger thread only loads the verdict.
+ *
+ *               Config format, one item per line, '#' starts a comment:
+ *                 psi <cpu|memory|io> <some|full> <pct>
+ *                                    avg10 of /proc/pressure/<res> above
+ *                                    <pct> (e.g. 40 or 12.5)
+ *                 file <path> <ms>   mtime older than <ms> (the file must
+ *                                    be touched, not replaced)
+ *                 pid <pid|pidfile>  process gone, zombie, stopped or in
+ *                                    uninterruptible sleep
+ *                 hold <ms>          bad time that closes the gate [10000]
+ *                 interval <ms>      probe interval [500]
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#ifdef LINUX
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <time.h>
+#	include <unistd.h>
+#	include <sys/stat.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include "wdog_ctrl_int.h"
+
+#ifdef LINUX
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define GATE_HOLD		10000	/**< default hold time [ms] */
+#define GATE_INTERVAL	500		/**< default probe interval [ms] */
+
+/***************************************************************************/
+/** Parse percent with up to two decimals
+ *
+ *  \param str        \IN  string, e.g. "12.5"
+ *  \param val        \OUT value [1/100 %]
+ *
+ *  \return           0 or -1 on error
+ */
+static int GatePct(const char *str, u_int32 *val)
+{
+	char *end;
+	u_int32 frac = 0;
+
+	*val = (u_int32)strtoul(str, &end, 10) * 100;
+	if (end == str)
+		return -1;
+	if (*end == '.') {
+		str = end + 1;
+		if (isdigit((unsigned char)*str))
+			frac = (*str++ - '0') * 10;
+		if (isdigit((unsigned char)*str))
+			frac += *str - '0';
+	}
+	*val += frac;
+	return 0;
+}
+
+/***************************************************************************/
+/** Add probe from config line
+ *
+ *  \param g          \INOUT gate
+ *  \param line       \IN  config line
+ *
+ *  \return           0, 1 if no probe line, -1 on error
+ */
+static int GateAdd(WDOG_GATE *g, char *line)
+{
+	GATE_PROBE *p = &g->probe[g->nProbes];
+	char kind[16], a1[200], a2[16], a3[16], path[256];
+	int32 pid;
+	FILE *fp;
+	int n;
+
+	if ((n = sscanf(line, "%15s %199s %15s %15s", kind, a1, a2, a3)) <= 0)
+		return 1;
+
+	if (!strcmp(kind, "hold") && (n == 2))
+		return (g->hold = atoi(a1)) > 0 ? 1 : -1;
+	if (!strcmp(kind, "interval") && (n == 2))
+		return (g->interval = atoi(a1)) > 0 ? 1 : -1;
+
+	if (g->nProbes == GATE_MAX_PROBES) {
+		printf("*** max. %d probes\n", GATE_MAX_PROBES);
+		return -1;
+	}
+
+	if (!strcmp(kind, "psi") && (n == 4)) {
+		p->kind = GATE_PSI;
+		if (!strcmp(a2, "full"))
+			p->full = 1;
+		else if (strcmp(a2, "some"))
+			return -1;
+		if (GatePct(a3, &p->limit) < 0)
+			return -1;
+		snprintf(path, sizeof(path), "/proc/pressure/%s", a1);
+		snprintf(p->name, sizeof(p->name), "psi %.8s %.4s avg10 > %.8s%%",
+				 a1, a2, a3);
+	}
+	else if (!strcmp(kind, "file") && (n == 3)) {
+		p->kind = GATE_FILE;
+		if ((p->limit = atoi(a2)) <= 0)
+			return -1;
+		snprintf(path, sizeof(path), "%s", a1);
+		snprintf(p->name, sizeof(p->name), "file %.32s older than %.10sms",
+				 a1, a2);
+	}
+	else if (!strcmp(kind, "pid") && (n == 2)) {
+		p->kind = GATE_PID;
+		pid = atoi(a1);
+		if ((pid <= 0) && (fp = fopen(a1, "r"))) {
+			if (fscanf(fp, "%d", &pid) != 1)
+				pid = 0;
+			fclose(fp);
+		}
+		if (pid <= 0)
+			return -1;
+		snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+		snprintf(p->name, sizeof(p->name), "pid %d", pid);
+	}
+	else
+		return -1;
+
+	if ((p->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		printf("*** can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	g->nProbes++;
+	return 0;
+}
+
+/***************************************************************************/
+/** Run probe
+ *
+ *  \param p          \IN  probe
+ *
+ *  \return           1 if bad, else 0
+ */
+static int GateProbe(GATE_PROBE *p)
+{
+	char buf[256], *s;
+	struct stat st;
+	struct timespec now;
+	u_int32 val;
+	ssize_t n;
+
+	switch (p->kind) {
+	case GATE_PSI:
+		/* some avg10=1.23 avg60=... \n full avg10=... */
+		if ((n = pread(p->fd, buf, sizeof(buf) - 1, 0)) <= 0)
+			return 0;
+		buf[n] = '\0';
+		if (!(s = strstr(buf, p->full ? "full avg10=" : "some avg10=")))
+			return 0;
+		return (GatePct(s + 11, &val) == 0) && (val > p->limit);
+
+	case GATE_FILE:
+		if (fstat(p->fd, &st) < 0)
+			return 1;
+		clock_gettime(CLOCK_REALTIME, &now);
+		return ((long long)(now.tv_sec - st.st_mtim.tv_sec) * 1000 +
+			(now.tv_nsec - st.st_mtim.tv_nsec) / 1000000) > (long long)p->limit;
+
+	case GATE_PID:
+		/* pid (comm) S ..., comm may contain ')' */
+		if ((n = pread(p->fd, buf, sizeof(buf) - 1, 0)) <= 0)
+			return 1;
+		buf[n] = '\0';
+		if (!(s = strrchr(buf, ')')) || !s[1] || !s[2])
+			return 1;
+		return strchr("DZXxTt", s[2]) != NULL;
+	}
+	return 0;
+}
+
+/***************************************************************************/
+/** Probe thread: run probes, publish verdict
+ *
+ *  \param arg        \IN  gate
+ *
+ *  \return           NULL
+ */
+static void *GateThread(void *arg)
+{
+	WDOG_GATE *g = (WDOG_GATE*)arg;
+	struct timespec ts;
+	u_int64 now;
+	int32 i, verdict;
+
+	pthread_mutex_lock(&g->lock);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	while (!g->stop) {
+		pthread_mutex_unlock(&g->lock);
+
+		now = NowUs();
+		verdict = GATE_OPEN;
+		for (i = 0; i < g->nProbes; i++) {
+			GATE_PROBE *p = &g->probe[i];
+
+			if (!GateProbe(p))
+				p->badSince = 0;
+			else if (!p->badSince)
+				p->badSince = now;
+			if (p->badSince && (verdict == GATE_OPEN) &&
+				(now - p->badSince >= (u_int64)g->hold * 1000))
+				verdict = i;
+		}
+		__sync_synchronize();
+		g->verdict = verdict;
+
+		ts.tv_sec += g->interval / 1000;
+		ts.tv_nsec += (g->interval % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&g->lock);
+		if (!g->stop)
+			pthread_cond_timedwait(&g->cond, &g->lock, &ts);
+	}
+	pthread_mutex_unlock(&g->lock);
+	return NULL;
+}
+
+/***************************************************************************/
+/** Load config, open probes and start probe thread
+ *
+ *  \param g          \OUT gate
+ *  \param file       \IN  config file
+ *
+ *  \return           success (0) or error code
+ */
+int GateInit(WDOG_GATE *g, const char *file)
+{
+	pthread_condattr_t ca;
+	sigset_t mask, oldMask;
+	char line[256];
+	int32 lineNbr = 0;
+	FILE *fp;
+	int err;
+
+	memset(g, 0, sizeof(*g));
+	g->hold = GATE_HOLD;
+	g->interval = GATE_INTERVAL;
+	g->verdict = GATE_OPEN;
+	g->shown = GATE_OPEN;
+
+	if (!(fp = fopen(file, "r"))) {
+		printf("*** can't open gate config %s\n", file);
+		return ERR_PARAM;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		lineNbr++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = '\0';
+		if (GateAdd(g, line) < 0) {
+			printf("*** %s line %d: illegal probe\n", file, lineNbr);
+			fclose(fp);
+			GateExit(g);
+			return ERR_PARAM;
+		}
+	}
+	fclose(fp);
+
+	if (!g->nProbes) {
+		printf("*** %s: no probes\n", file);
+		return ERR_PARAM;
+	}
+	printf("Health gate: %d probes, hold %ums, interval %ums\n",
+		g->nProbes, g->hold, g->interval);
+
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_init(&g->cond, &ca);
+	pthread_condattr_destroy(&ca);
+
+	/* signals (SIGTERM, irq signal) stay with the trigger thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &oldMask);
+	err = pthread_create(&g->thr, NULL, GateThread, g);
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+	if (err != 0) {
+		printf("*** can't create probe thread: %s\n", strerror(err));
+		GateExit(g);
+		return ERR_FUNC;
+	}
+	g->running = 1;
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Stop probe thread, close probes, print summary
+ *
+ *  \param g          \IN  gate
+ */
+void GateExit(WDOG_GATE *g)
+{
+	int32 i;
+
+	if (g->running) {
+		pthread_mutex_lock(&g->lock);
+		g->stop = 1;
+		pthread_cond_signal(&g->cond);
+		pthread_mutex_unlock(&g->lock);
+		pthread_join(g->thr, NULL);
+		pthread_cond_destroy(&g->cond);
+		pthread_mutex_destroy(&g->lock);
+		g->running = 0;
+		printf("Health gate: closed %u times, %u passes without trigger\n",
+			g->closed, g->gated);
+	}
+	for (i = 0; i < g->nProbes; i++)
+		close(g->probe[i].fd);
+	g->nProbes = 0;
+}
+
+#else /* !LINUX */
+
+/***************************************************************************/
+/** Load config - not supported
+ *
+ *  \return           ERR_PARAM
+ */
+int GateInit(WDOG_GATE *g, const char *file)
+{
+	memset(g, 0, sizeof(*g));
+	g->verdict = g->shown = GATE_OPEN;
+	printf("*** -G not supported on this system\n");
+	return ERR_PARAM;
+}
+
+/***************************************************************************/
+/** Release gate - not supported
+ */
+void GateExit(WDOG_GATE *g)
+{
+}
+
+#endif /* LINUX */
+
+/***************************************************************************/
+/** Check verdict of the probe thread
+ *
+ *  Only loads the verdict, so it adds no latency to the trigger path.
+ *  Prints a line when the gate closes or opens again.
+ *
+ *  \param g          \INOUT gate
+ *
+ *  \return           1 if open (trigger), 0 if closed
+ */
+int GateOpen(WDOG_GATE *g)
+{
+	int32 verdict = g->verdict;
+
+	if (verdict != g->shown) {
+		if (verdict == GATE_OPEN)
+			printf("Health gate open again - triggering resumed\n");
+		else {
+			printf("*** health gate closed by %s - triggering stopped\n",
+				g->probe[verdict].name);
+			if (g->shown == GATE_OPEN)
+				g->closed++;
+		}
+		g->shown = verdict;
+	}
+	if (verdict != GATE_OPEN)
+		g->gated++;
+	return verdict == GATE_OPEN;
+}
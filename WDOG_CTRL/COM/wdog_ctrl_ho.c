@@ -0,0 +1,617 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                   WDOG_CTRL_HO                     ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_ho.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Handover of a running trigger loop to a new instance (-H)
+ *
+ *               The running instance listens on a unix socket. A new
+ *               instance started with the same socket connects instead
+ *               of opening the device:
+ *
+ *                 new         calibrate (-p), then connect
+ *                 new -> old  HO_HELLO: period, pattern mode
+ *                 old         trigger as usual, check the new period
+ *                             against min./max. time and the pattern mode
+ *                 old -> new  HO_REJECT with reason, old continues or
+ *                 old -> new  HO_STATE + MDIS path (SCM_RIGHTS): period,
+ *                             pattern index, last trigger, next deadline
+ *                 old         never triggers again, exit without
+ *                             WDOG_STOP and M_close
+ *                 new         trigger at the next deadline
+ *                 new -> old  HO_CONFIRM with the trigger time (report)
+ *
+ *               Ownership moves with HO_STATE, so there is never more
+ *               than one instance triggering. If the new instance fails
+ *               after HO_STATE, the watchdog expires. The old instance
+ *               waits for the confirmation at most min(period, max. time)
+ *               after the deadline, only to report the trigger gap.
+ *
+ *               The socket is created with mode 0600 in a directory owned
+ *               by root or the effective user that is not writable for
+ *               group and others (e.g. /run). Both sides only talk to a
+ *               peer with the same effective uid (SO_PEERCRED).
+ *
+ *               Both sides use CLOCK_MONOTONIC, which is system-wide, so
+ *               the time stamps can be compared directly. The MDIS path
+ *               is a file descriptor on Linux and can be passed as is.
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#ifdef LINUX
+#	define _GNU_SOURCE		/* struct ucred */
+#endif
+#include <stdio.h>
+#include <string.h>
+#ifdef LINUX
+#	include <errno.h>
+#	include <poll.h>
+#	include <unistd.h>
+#	include <sys/socket.h>
+#	include <sys/stat.h>
+#	include <sys/un.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+#ifdef LINUX
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define HO_MAGIC	0x57444f47	/* "WDOG" */
+#define HO_HELLO	1
+#define HO_STATE	2
+#define HO_CONFIRM	3
+#define HO_REJECT	4
+
+/*--------------------------------------+
+|   TYPDEFS                             |
++--------------------------------------*/
+/** handover message */
+typedef struct {
+	u_int32	magic;		/**< HO_MAGIC */
+	u_int32	type;		/**< HO_xxx */
+	int32	trigT;		/**< trigger period [ms] */
+	int32	usePat;		/**< trigger with pattern */
+	int32	patIdx;		/**< index of next pattern */
+	u_int32	count;		/**< passes so far */
+	u_int64	lastTrig;	/**< last trigger [us, monotonic] */
+	u_int64	next;		/**< next deadline [us, monotonic] */
+	char	text[128];	/**< HO_REJECT: reason */
+} HO_MSG;
+
+/***************************************************************************/
+/** Build unix socket address
+ *
+ *  \param addr       \OUT address
+ *  \param path       \IN  socket path
+ *  \param what       \IN  socket name for messages
+ *
+ *  \return           0 or -1 if path too long
+ */
+static int HoAddr(struct sockaddr_un *addr, const char *path, const char *what)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		printf("*** %s socket path too long\n", what);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+/***************************************************************************/
+/** Check directory of socket: owned by root or us, not writable for others
+ *
+ *  Otherwise another user could replace the socket file.
+ *
+ *  \param addr       \IN  address
+ *  \param what       \IN  socket name for messages
+ *
+ *  \return           0 or -1 if unsafe
+ */
+static int HoSockDir(const struct sockaddr_un *addr, const char *what)
+{
+	char dir[sizeof(addr->sun_path)];
+	struct stat st;
+	char *p;
+
+	strcpy(dir, addr->sun_path);
+	if (!(p = strrchr(dir, '/')))
+		strcpy(dir, ".");
+	else if (p == dir)
+		p[1] = '\0';
+	else
+		*p = '\0';
+
+	if ((stat(dir, &st) < 0) || !S_ISDIR(st.st_mode) ||
+		((st.st_uid != 0) && (st.st_uid != geteuid())) ||
+		(st.st_mode & (S_IWGRP | S_IWOTH))) {
+		printf("*** %s socket: directory %s must be owned by root or the user "
+			   "and not writable for others (e.g. /run)\n", what, dir);
+		return -1;
+	}
+	return 0;
+}
+
+/***************************************************************************/
+/** Check that the peer runs with our effective uid
+ *
+ *  \param fd         \IN  connected socket
+ *
+ *  \return           0 or -1 if foreign peer
+ */
+int HoSockPeer(int fd)
+{
+	struct ucred cr;
+	socklen_t len = sizeof(cr);
+
+	if ((getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cr, &len) < 0) ||
+		(cr.uid != geteuid()))
+		return -1;
+	return 0;
+}
+
+/***************************************************************************/
+/** Listen on private unix socket (mode 0600, safe directory)
+ *
+ *  A stale socket file of a terminated instance is replaced.
+ *
+ *  \param path       \IN  socket path
+ *  \param backlog    \IN  listen backlog
+ *  \param what       \IN  socket name for messages
+ *
+ *  \return           listening socket or -1 on error
+ */
+int HoSockListen(const char *path, int backlog, const char *what)
+{
+	struct sockaddr_un addr;
+	mode_t oldMask;
+	int fd, err;
+
+	if ((HoAddr(&addr, path, what) < 0) || (HoSockDir(&addr, what) < 0))
+		return -1;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		printf("*** %s socket: %s\n", what, strerror(errno));
+		return -1;
+	}
+	unlink(path);
+	oldMask = umask(077);
+	err = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(oldMask);
+	if ((err < 0) || (chmod(path, 0600) < 0) || (listen(fd, backlog) < 0)) {
+		printf("*** %s socket: %s\n", what, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/***************************************************************************/
+/** Receive message, wait until absolute time
+ *
+ *  \param fd         \IN  socket
+ *  \param msg        \OUT message
+ *  \param type       \IN  expected message type, 0=any
+ *  \param until      \IN  timeout [us, monotonic]
+ *  \param rxFd       \OUT received fd (-1 if none) or NULL
+ *
+ *  \return           0 or -1 on timeout/error
+ */
+static int HoRecv(int fd, HO_MSG *msg, u_int32 type, u_int64 until, int *rxFd)
+{
+	struct pollfd pfd;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	char ctrl[CMSG_SPACE(sizeof(int))];
+	u_int64 now;
+	int n;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		now = NowUs();
+		if (now >= until)
+			return -1;
+		n = poll(&pfd, 1, (int)((until - now + 999) / 1000));
+		if (n > 0)
+			break;
+		if (n < 0 && errno != EINTR)
+			return -1;
+	}
+
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = msg;
+	iov.iov_len = sizeof(*msg);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctrl;
+	mh.msg_controllen = sizeof(ctrl);
+
+	if ((recvmsg(fd, &mh, 0) != sizeof(*msg)) ||
+		(msg->magic != HO_MAGIC) || (type && (msg->type != type)))
+		return -1;
+
+	/* fd passed with the message, if any */
+	if (rxFd) {
+		*rxFd = -1;
+		cm = CMSG_FIRSTHDR(&mh);
+		if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+			memcpy(rxFd, CMSG_DATA(cm), sizeof(int));
+	}
+	msg->text[sizeof(msg->text) - 1] = '\0';
+	return 0;
+}
+
+/***************************************************************************/
+/** Send message
+ *
+ *  \param fd         \IN  socket
+ *  \param msg        \IN  message
+ *  \param txFd       \IN  fd to pass or -1
+ *
+ *  \return           0 or -1 on error
+ */
+static int HoSend(int fd, HO_MSG *msg, int txFd)
+{
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	char ctrl[CMSG_SPACE(sizeof(int))];
+
+	msg->magic = HO_MAGIC;
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = msg;
+	iov.iov_len = sizeof(*msg);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+
+	if (txFd >= 0) {
+		memset(ctrl, 0, sizeof(ctrl));
+		mh.msg_control = ctrl;
+		mh.msg_controllen = sizeof(ctrl);
+		cm = CMSG_FIRSTHDR(&mh);
+		cm->cmsg_level = SOL_SOCKET;
+		cm->cmsg_type = SCM_RIGHTS;
+		cm->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cm), &txFd, sizeof(int));
+	}
+
+	return sendmsg(fd, &mh, MSG_NOSIGNAL) == sizeof(*msg) ? 0 : -1;
+}
+
+/***************************************************************************/
+/** Listen for a new instance
+ *
+ *  \param path       \IN  socket path
+ *
+ *  \return           listening socket or -1 on error
+ */
+int HoListen(const char *path)
+{
+	return HoSockListen(path, 1, "handover");
+}
+
+/***************************************************************************/
+/** Accept connection of a new instance of the same user
+ *
+ *  \param lfd        \IN  listening socket
+ *
+ *  \return           connected socket or -1 on error/foreign peer
+ */
+int HoAccept(int lfd)
+{
+	int fd;
+
+	if ((fd = accept(lfd, NULL, NULL)) < 0)
+		return -1;
+	if (HoSockPeer(fd) < 0) {
+		printf("*** handover: connection of other user refused\n");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/***************************************************************************/
+/** Check if the new instance may take over
+ *
+ *  \param lp         \IN  loop state
+ *  \param hello      \IN  HO_HELLO of the new instance
+ *  \param reason     \OUT reason if not
+ *  \param size       \IN  size of reason
+ *
+ *  \return           0 if ok, -1 if not
+ */
+static int HoCheck(WDOG_LOOP *lp, const HO_MSG *hello, char *reason, size_t size)
+{
+	int32 maxT, minT;
+
+	if (hello->usePat != lp->usePat) {
+		/* mode may have been switched by control command 'pattern' */
+		snprintf(reason, size, "running instance %s pattern (-%c or control "
+			"command), new instance uses -%c", lp->usePat ? "uses" : "doesn't use",
+			lp->usePat ? 'P' : 'T', hello->usePat ? 'P' : 'T');
+		return -1;
+	}
+	if ((CapMaxTime(&maxT) == 0) && (maxT > 0) &&
+		((u_int64)hello->trigT * 1000 >= (u_int64)maxT)) {
+		snprintf(reason, size, "period %dms not below max. time %dus",
+			hello->trigT, maxT);
+		return -1;
+	}
+	if (CapHas(WDOG_TIME_MIN, 0) &&
+		(M_getstat(G_path, WDOG_TIME_MIN, &minT) == 0) &&
+		((u_int64)hello->trigT * 1000 <= (u_int64)minT)) {
+		snprintf(reason, size, "period %dms not above min. time %dus",
+			hello->trigT, minT);
+		return -1;
+	}
+	return 0;
+}
+
+/***************************************************************************/
+/** Hand trigger loop over to new instance
+ *
+ *  Called right after a trigger. Once the state is sent, the new
+ *  instance owns the watchdog: the caller must not trigger again, even
+ *  if the confirmation doesn't arrive.
+ *
+ *  \param cfd        \IN  connected socket (closed here)
+ *  \param lp         \IN  loop state
+ *  \param lastTrig   \IN  last trigger [us, monotonic]
+ *  \param next       \IN  next deadline [us, monotonic]
+ *
+ *  \return           ERR_OK if the new instance owns the watchdog,
+ *                    else keep triggering
+ */
+int HoHandOver(int cfd, WDOG_LOOP *lp, u_int64 lastTrig, u_int64 next)
+{
+	HO_MSG msg;
+	u_int64 wait;
+	int32 maxT;
+	int ret = ERR_FUNC;
+
+	/* hello is queued since connect */
+	if (HoRecv(cfd, &msg, HO_HELLO, NowUs() + 100000, NULL) < 0) {
+		printf("*** handover: no hello from new instance\n");
+		goto EXIT;
+	}
+	if (HoCheck(lp, &msg, msg.text, sizeof(msg.text)) < 0) {
+		printf("*** handover rejected: %s\n", msg.text);
+		msg.type = HO_REJECT;
+		HoSend(cfd, &msg, -1);
+		goto EXIT;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type     = HO_STATE;
+	msg.trigT    = lp->trigT;
+	msg.usePat   = lp->usePat;
+	msg.patIdx   = lp->patIdx;
+	msg.count    = lp->count;
+	msg.lastTrig = lastTrig;
+	msg.next     = next;
+	if (HoSend(cfd, &msg, G_path) < 0) {
+		printf("*** handover: can't send state\n");
+		goto EXIT;
+	}
+
+	/* the new instance owns the watchdog now, wait only for the report */
+	ret = ERR_OK;
+	wait = (u_int64)lp->trigT * 1000;
+	if ((CapMaxTime(&maxT) == 0) && (maxT > 0) && ((u_int64)maxT < wait))
+		wait = maxT;
+	if (HoRecv(cfd, &msg, HO_CONFIRM, next + wait, NULL) < 0) {
+		printf("*** handover: no confirmation from new instance\n");
+		goto EXIT;
+	}
+
+	printf("Watchdog handed over - trigger gap %lluus (period %dms)\n",
+		(unsigned long long)(msg.lastTrig - lastTrig), lp->trigT);
+
+EXIT:
+	close(cfd);
+	return ret;
+}
+
+/***************************************************************************/
+/** Take over trigger loop from running instance
+ *
+ *  On success, G_path is the path of the running instance and the loop
+ *  has to trigger at lp->hoNext, then call HoConfirm().
+ *
+ *  \param lp         \INOUT loop state, hoPath set
+ *
+ *  \return           ERR_OK if taken over, HO_NONE if no instance is
+ *                    running or error code
+ */
+int HoConnect(WDOG_LOOP *lp)
+{
+	struct sockaddr_un addr;
+	HO_MSG msg;
+	int fd, rxFd = -1;
+
+	if (HoAddr(&addr, lp->hoPath, "handover") < 0)
+		return ERR_PARAM;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		perror("*** handover socket");
+		return ERR_FUNC;
+	}
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return HO_NONE;
+	}
+	if (HoSockPeer(fd) < 0) {
+		printf("*** handover: socket belongs to other user\n");
+		close(fd);
+		return ERR_FUNC;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type   = HO_HELLO;
+	msg.trigT  = lp->trigT;
+	msg.usePat = lp->usePat;
+
+	/* old instance answers after its next trigger */
+	if ((HoSend(fd, &msg, -1) < 0) ||
+		(HoRecv(fd, &msg, 0, NowUs() + 10000000, &rxFd) < 0)) {
+		printf("*** handover: no state from running instance\n");
+		close(fd);
+		return ERR_FUNC;
+	}
+	if (msg.type == HO_REJECT) {
+		printf("*** handover rejected: %s\n", msg.text);
+		close(fd);
+		return ERR_PARAM;
+	}
+	if ((msg.type != HO_STATE) || (rxFd < 0)) {
+		printf("*** handover: illegal answer from running instance\n");
+		if (rxFd >= 0)
+			close(rxFd);
+		close(fd);
+		return ERR_FUNC;
+	}
+	if (msg.trigT != lp->trigT)
+		printf("Handover: period %dms -> %dms after first trigger\n",
+			msg.trigT, lp->trigT);
+
+	G_path     = rxFd;
+	lp->hoFd   = fd;
+	lp->hoLast = msg.lastTrig;
+	lp->hoNext = msg.next;
+	lp->patIdx = msg.patIdx;
+	lp->count  = msg.count;
+	lp->takeover = 1;
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Confirm first trigger to old instance
+ *
+ *  \param lp         \INOUT loop state
+ *  \param trig       \IN  time of first trigger [us, monotonic]
+ */
+void HoConfirm(WDOG_LOOP *lp, u_int64 trig)
+{
+	HO_MSG msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type     = HO_CONFIRM;
+	msg.lastTrig = trig;
+	/* only a report, the old instance doesn't trigger anymore */
+	if (HoSend(lp->hoFd, &msg, -1) < 0)
+		printf("*** handover: can't confirm\n");
+
+	printf("Watchdog taken over - trigger gap %lluus\n",
+		(unsigned long long)(trig - lp->hoLast));
+	close(lp->hoFd);
+	lp->hoFd = -1;
+}
+
+#else /* !LINUX */
+
+/***************************************************************************/
+/** Check peer of socket - not supported
+ *
+ *  \return           -1
+ */
+int HoSockPeer(int fd)
+{
+	return -1;
+}
+
+/***************************************************************************/
+/** Listen on private unix socket - not supported
+ *
+ *  \return           -1
+ */
+int HoSockListen(const char *path, int backlog, const char *what)
+{
+	printf("*** %s socket not supported on this system\n", what);
+	return -1;
+}
+
+/***************************************************************************/
+/** Listen for a new instance - not supported
+ *
+ *  \return           -1
+ */
+int HoListen(const char *path)
+{
+	printf("*** -H not supported on this system\n");
+	return -1;
+}
+
+/***************************************************************************/
+/** Accept connection - not supported
+ *
+ *  \return           -1
+ */
+int HoAccept(int lfd)
+{
+	return -1;
+}
+
+/***************************************************************************/
+/** Hand trigger loop over - not supported
+ *
+ *  \return           ERR_FUNC
+ */
+int HoHandOver(int cfd, WDOG_LOOP *lp, u_int64 lastTrig, u_int64 next)
+{
+	return ERR_FUNC;
+}
+
+/***************************************************************************/
+/** Take over trigger loop - not supported
+ *
+ *  \return           ERR_PARAM
+ */
+int HoConnect(WDOG_LOOP *lp)
+{
+	printf("*** -H not supported on this system\n");
+	return ERR_PARAM;
+}
+
+/***************************************************************************/
+/** Confirm first trigger - not supported
+ */
+void HoConfirm(WDOG_LOOP *lp, u_int64 trig)
+{
+}
+
+#endif /* LINUX */
@@ -0,0 +1,477 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_INT                     ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_int.h
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Internal definitions shared by the WDOG_CTRL modules
+ *
+ *    \switches  LINUX - use timerfd/signalfd/epoll based event loop
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+#ifndef _WDOG_CTRL_INT_H
+#define _WDOG_CTRL_INT_H
+
+#ifdef LINUX
+#	include <termios.h>
+#	include <signal.h>
+#	include <pthread.h>
+#endif
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define ERR_OK		0
+#define ERR_PARAM	1
+#define ERR_FUNC	2
+
+#define PRINT_ERR	printf("*** error: %s\n", M_errstring(UOS_ErrnoGet()));
+
+/* event loop wait results */
+#define EVT_TIMER	0	/**< trigger deadline reached */
+#define EVT_KEY		1	/**< key pressed */
+#define EVT_TERM	2	/**< SIGTERM/SIGINT received */
+#define EVT_FD		3	/**< watched fd readable */
+#define EVT_WAKE	4	/**< EvtWake() called */
+#define EVT_ERR		-1	/**< wait failed */
+
+#define EVT_MAX_FDS	16	/**< max. fds reported by one wait */
+
+#define HO_NONE		-1	/**< HoConnect(): no instance to take over */
+
+/* number of status codes in G_wdogCode */
+#define WDOG_CODES		12
+
+/* histogram buckets: 0..63 exact, then 32 per power of two up to 2^32 */
+#define STAT_BUCKETS	(64 + 26 * 32)
+
+/* fault injection kinds */
+#define FAULT_NONE		0
+#define FAULT_DELAY		1	/**< trigger <arg> ms late */
+#define FAULT_SKIP		2	/**< omit trigger */
+#define FAULT_BADPAT	3	/**< trigger with wrong pattern */
+#define FAULT_BURST		4	/**< <arg> triggers back-to-back */
+
+/* perf counters per trigger pass (-K) */
+#define PERF_CYCLES		0
+#define PERF_INSTR		1
+#define PERF_CSW		2	/**< context switches */
+#define PERF_FAULTS		3	/**< page faults */
+#define PERF_MIGR		4	/**< CPU migrations */
+#define PERF_EVENTS		5
+
+#define PERF_WAIT		0	/**< phase: until deadline */
+#define PERF_TRIG		1	/**< phase: trigger setstat */
+#define PERF_PHASES		2
+
+/* cause of a slow pass */
+#define PERF_CAUSE_OK		0
+#define PERF_CAUSE_PREEMPT	1	/**< context switch */
+#define PERF_CAUSE_MIGR		2	/**< migrated to other CPU */
+#define PERF_CAUSE_FAULT	3	/**< page fault */
+#define PERF_CAUSE_DRV		4	/**< slow in driver */
+#define PERF_CAUSE_LATE		5	/**< late wakeup */
+#define PERF_CAUSES			6
+
+/* flight recorder entry kinds (-f) */
+#define REC_START		1
+#define REC_TRIG		2
+#define REC_IRQ			3	/**< irq signal */
+#define REC_FAULT		4	/**< injected fault instead of trigger */
+#define REC_STOP		5
+#define REC_HANDOVER	6
+#define REC_GATED		7	/**< no trigger, health gate closed */
+#define REC_ENTRIES		4096	/**< ring size */
+
+/* health gate (-G) */
+#define GATE_MAX_PROBES	16
+#define GATE_OPEN		-1	/**< verdict: trigger */
+#define GATE_PSI		1	/**< pressure stall information */
+#define GATE_FILE		2	/**< file mtime */
+#define GATE_PID		3	/**< process state */
+
+/* auto period (-a) */
+#define AUTO_NWIN		10	/**< windows for the latency tail */
+
+/* control socket (-C) commands */
+#define CTL_MAX			1
+#define CTL_MIN			2
+#define CTL_IRQ			3
+#define CTL_PERIOD		4
+#define CTL_PATTERN		5
+#define CTL_VERBOSE		6
+#define CTL_INFO		7
+#define CTL_QLEN		16	/**< ring size */
+#define CTL_TEXT		384	/**< max. reply length */
+
+/*--------------------------------------+
+|   TYPDEFS                             |
++--------------------------------------*/
+/** event loop: single wait point for timer, keypress and termination */
+typedef struct {
+	u_int64	deadline;	/**< last timer expiry [us, monotonic] */
+	u_int64	next;		/**< next timer expiry [us, monotonic] */
+	u_int32	period;		/**< timer period [us], 0=one-shot */
+	u_int32	overrun;	/**< timer expirations missed so far */
+	int		fd;			/**< readable fd for EVT_FD */
+#ifdef LINUX
+	int		epFd;		/**< epoll instance */
+	int		tmrFd;		/**< timerfd (CLOCK_MONOTONIC) */
+	int		sigFd;		/**< signalfd for SIGTERM/SIGINT */
+	int		keyFd;		/**< stdin if it is a terminal, else -1 */
+	int		wakeRd;		/**< wake pipe, read end or -1 */
+	int		wakeWr;		/**< wake pipe, write end or -1 */
+	struct termios	tio;	/**< saved terminal settings */
+	sigset_t	sigMask;	/**< saved signal mask */
+#endif
+} WDOG_EVT;
+
+/** WDOG status code and its name */
+typedef struct {
+	int32	code;		/**< WDOG_xxx code */
+	char	*name;		/**< name, e.g. "WDOG_TIME" */
+} WDOG_CODE;
+
+/** distribution of time values [us] */
+typedef struct {
+	u_int32	count;		/**< number of values */
+	u_int32	min;		/**< min. value */
+	u_int32	max;		/**< max. value */
+	u_int64	sum;		/**< sum of values */
+	double	sumSq;		/**< sum of squared values */
+	u_int32	hist[STAT_BUCKETS];	/**< log-linear histogram */
+} WDOG_STAT;
+
+/** fault to inject */
+typedef struct {
+	int32	pass;		/**< pass number (1..n) */
+	int32	kind;		/**< FAULT_xxx */
+	int32	arg;		/**< delay [ms] or burst count */
+} WDOG_FAULT_EV;
+
+/** fault injection */
+typedef struct {
+	u_int64	rng;		/**< random generator state */
+	int32	pct;		/**< probability of a random fault [%] */
+	int32	usePat;		/**< loop triggers with pattern */
+	WDOG_FAULT_EV *script;	/**< scripted faults or NULL for random */
+	int		nScript;	/**< number of scripted faults */
+	int		next;		/**< next scripted fault */
+	u_int64	start;		/**< loop start [us] */
+	u_int32	injected;	/**< faults injected */
+	u_int32	fired;		/**< out/irq reasons reported */
+} WDOG_FAULT;
+
+/** compiled schedule action */
+typedef struct {
+	int32	op;			/**< SCHED_xxx */
+	int32	line;		/**< script line */
+	int32	code;		/**< status code (ramp: step) */
+	int32	arg;		/**< value/time [ms]/count */
+	int32	arg2;		/**< count/end time */
+	int32	arg3;		/**< pattern flag/compare op/jump index */
+	int32	cnt;		/**< repeat counter at run time */
+} SCHED_ACT;
+
+/** compiled schedule */
+typedef struct {
+	SCHED_ACT *act;		/**< action table */
+	int32	nActs;		/**< number of actions */
+	int32	alloc;		/**< allocated actions */
+	int32	usePat;		/**< schedule triggers with pattern */
+	int32	patIdx;		/**< index of next pattern */
+	int32	started;	/**< watchdog started by schedule */
+	u_int64	deadline;	/**< last deadline [us] */
+	u_int32	trigs;		/**< triggers done */
+	u_int32	failed;		/**< failed expectations */
+} WDOG_SCHED;
+
+/** perf counters per trigger pass */
+typedef struct {
+	int		fd[PERF_EVENTS];	/**< counter fds, -1=not available */
+	int		idx[PERF_EVENTS];	/**< position in group read or -1 */
+	int		lead;				/**< index of group leader */
+	FILE	*out;				/**< record file */
+	u_int64	mark[PERF_EVENTS];	/**< counters at last mark */
+	u_int64	markT;				/**< time of last mark [us] */
+	u_int64	phaseT[PERF_PHASES];	/**< end of phase [us] */
+	u_int64	delta[PERF_PHASES][PERF_EVENTS];	/**< counters per phase */
+	WDOG_STAT lateSt;			/**< wakeup lateness */
+	WDOG_STAT trigSt;			/**< trigger time */
+	u_int32	lateThr;			/**< lateness of a slow pass [us] */
+	u_int32	trigThr;			/**< trigger time of a slow pass [us] */
+	u_int32	cause[PERF_CAUSES];	/**< passes per cause */
+} WDOG_PERF;
+
+/** flight recorder entry (32 bytes) */
+typedef struct {
+	u_int64	t;			/**< time [us, monotonic] */
+	u_int32	seq;		/**< entry number + 1, written last */
+	u_int32	pass;		/**< pass number */
+	u_int32	interval;	/**< time since last trigger [us] */
+	int32	margin;		/**< max. time minus interval [us] */
+	int32	result;		/**< setstat result (0 or MDIS error code) */
+	u_int16	kind;		/**< REC_xxx */
+	u_int16	arg;		/**< kind specific */
+} WDOG_REC_ENT;
+
+/** flight recorder file header, followed by the entries */
+typedef struct {
+	char	magic[8];	/**< REC_MAGIC */
+	u_int32	entSize;	/**< sizeof(WDOG_REC_ENT) */
+	u_int32	nEnt;		/**< number of entries */
+	u_int32	head;		/**< entries written so far */
+	int32	pid;		/**< recording process */
+	int32	trigT;		/**< trigger period [ms] */
+	int32	maxT;		/**< max. time [us], 0=unknown */
+	u_int64	monoStart;	/**< start [us, monotonic] */
+	u_int64	realStart;	/**< start [us, realtime] */
+	char	bootId[40];	/**< boot id of recording system */
+	char	device[32];	/**< device name */
+} WDOG_REC_HDR;
+
+/** flight recorder */
+typedef struct {
+	WDOG_REC_HDR *hdr;	/**< mapped file */
+	WDOG_REC_ENT *ent;	/**< entries in mapped file */
+	size_t	size;		/**< mapping size */
+	u_int64	lastTrig;	/**< last trigger [us] */
+#ifdef LINUX
+	pthread_t thr;		/**< sync thread */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int		stop;		/**< stop sync thread */
+#endif
+} WDOG_REC;
+
+/** health gate probe */
+typedef struct {
+	int		kind;		/**< GATE_xxx */
+	int		fd;			/**< persistent fd, read with pread/fstat */
+	int		full;		/**< GATE_PSI: full instead of some */
+	u_int32	limit;		/**< PSI [1/100 %] or max. file age [ms] */
+	u_int64	badSince;	/**< bad since [us], 0=good */
+	char	name[64];	/**< for messages */
+} GATE_PROBE;
+
+/** health gate */
+typedef struct {
+	GATE_PROBE probe[GATE_MAX_PROBES];
+	int32	nProbes;
+	u_int32	hold;		/**< bad time that closes the gate [ms] */
+	u_int32	interval;	/**< probe interval [ms] */
+	volatile int32 verdict;	/**< GATE_OPEN or index of closing probe */
+	int32	shown;		/**< verdict last printed */
+	u_int32	closed;		/**< times closed */
+	u_int32	gated;		/**< passes without trigger */
+	int		running;	/**< probe thread running */
+#ifdef LINUX
+	pthread_t thr;		/**< probe thread */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int		stop;		/**< stop probe thread */
+#endif
+} WDOG_GATE;
+
+/** self-tuning trigger period */
+typedef struct {
+	int32	margin;		/**< safety margin [% of max. time] */
+	u_int32	limit;		/**< max. time minus margin [us] */
+	u_int32	minPeriod;	/**< min. time plus margin [ms] */
+	u_int32	period;		/**< current period [ms] */
+	u_int32	tail;		/**< latency tail estimate [us] */
+	WDOG_STAT win;		/**< latency of current window */
+	u_int32	pct[AUTO_NWIN];	/**< p99.99 of the last windows [us] */
+	u_int32	idx;		/**< next slot in pct */
+	u_int32	nWin;		/**< windows in pct */
+	u_int32	changes;	/**< period changes */
+	u_int32	minT;		/**< shortest period used [ms] */
+	u_int32	maxT;		/**< longest period used [ms] */
+	int32	clamped;	/**< margin couldn't be kept */
+} WDOG_AUTO;
+
+/** cached capabilities of a device, bit/index per G_wdogCode */
+typedef struct {
+	u_int32	rev;		/**< hash of driver revision */
+	u_int32	get;		/**< getstat supported */
+	u_int32	set;		/**< setstat supported (time codes) */
+	int32	min[WDOG_CODES];	/**< smallest accepted value, 0=unknown */
+	int32	max[WDOG_CODES];	/**< largest accepted value, 0=unknown */
+	int32	res[WDOG_CODES];	/**< resolution, 0=unknown */
+} WDOG_CAP;
+
+/** control command */
+typedef struct {
+	int32	op;			/**< CTL_xxx */
+	int32	arg;		/**< value */
+	u_int32	client;		/**< client id */
+} CTL_CMD;
+
+/** control reply */
+typedef struct {
+	u_int32	client;		/**< client id */
+	char	text[CTL_TEXT];
+} CTL_REP;
+
+/** control socket, rings single producer/single consumer */
+typedef struct {
+	const char *path;	/**< socket path */
+	CTL_CMD	cmd[CTL_QLEN];	/**< control thread -> trigger loop */
+	volatile u_int32 cmdHead;
+	volatile u_int32 cmdTail;
+	CTL_REP	rep[CTL_QLEN];	/**< trigger loop -> control thread */
+	volatile u_int32 repHead;
+	volatile u_int32 repTail;
+	u_int32	dropped;	/**< replies dropped, ring full */
+	WDOG_EVT *evt;		/**< trigger loop to wake */
+	int		lfd;		/**< listening socket */
+	int		notifyRd;	/**< reply notification pipe */
+	int		notifyWr;
+	int		running;	/**< control thread running */
+#ifdef LINUX
+	pthread_t thr;		/**< control thread */
+	volatile int stop;	/**< stop control thread */
+#endif
+} WDOG_CTL;
+
+/** trigger loop state */
+typedef struct {
+	int32	trigT;		/**< trigger period [ms] */
+	int32	incrT;		/**< period increment per pass [ms] */
+	int32	usePat;		/**< trigger with alternating pattern */
+	int32	patIdx;		/**< index of next pattern */
+	int32	abort;		/**< abort after n passes (-1=never) */
+	int32	verbose;	/**< verbose output */
+	int32	precise;	/**< precision mode: spin until deadline */
+	u_int32	spin;		/**< precision mode: calibrated spin time [us] */
+	int32	irqDrive;	/**< trigger at irq signal, timer only fallback */
+	int32	autoPct;	/**< auto period margin [%], -1=off */
+	u_int32	count;		/**< passes so far */
+	WDOG_FAULT *flt;	/**< fault injection or NULL */
+	WDOG_PERF *perf;	/**< perf counters or NULL */
+	WDOG_REC *rec;		/**< flight recorder or NULL */
+	WDOG_GATE *gate;	/**< health gate or NULL */
+	WDOG_CTL *ctl;		/**< control socket or NULL */
+	const char *hoPath;	/**< handover socket or NULL */
+	int		hoFd;		/**< connection to old instance after takeover */
+	u_int64	hoLast;		/**< last trigger of old instance [us] */
+	u_int64	hoNext;		/**< first deadline after takeover [us] */
+	int32	takeover;	/**< loop taken over from old instance */
+	int32	handedOver;	/**< loop handed over to new instance */
+} WDOG_LOOP;
+
+/*--------------------------------------+
+|   EXTERNALS                           |
++--------------------------------------*/
+extern MDIS_PATH G_path;
+extern const WDOG_CODE G_wdogCode[WDOG_CODES];
+
+/*--------------------------------------+
+|  PROTOTYPES                           |
++--------------------------------------*/
+/* wdog_ctrl.c */
+int PrintError(char *info);
+int GetInfo(void);
+
+/* wdog_ctrl_evt.c */
+u_int64 NowUs(void);
+int EvtInit(WDOG_EVT *evt);
+void EvtArm(WDOG_EVT *evt, u_int64 deadline, u_int32 period);
+int EvtWait(WDOG_EVT *evt);
+int EvtWatch(WDOG_EVT *evt, int fd);
+void EvtUnwatch(WDOG_EVT *evt, int fd);
+int EvtWakeInit(WDOG_EVT *evt);
+void EvtWake(WDOG_EVT *evt);
+void EvtExit(WDOG_EVT *evt);
+
+/* wdog_ctrl_snap.c */
+int Snapshot(int argc, char *argv[], int nThreads);
+
+/* wdog_ctrl_fault.c */
+int FaultInit(WDOG_FAULT *flt, const char *script, u_int32 seed, int32 pct,
+			  int32 usePat);
+int FaultNext(WDOG_FAULT *flt, u_int32 pass, int32 trigT, WDOG_FAULT_EV *ev);
+void FaultLog(WDOG_FAULT *flt, WDOG_FAULT_EV *ev);
+void FaultExit(WDOG_FAULT *flt);
+
+/* wdog_ctrl_stat.c */
+void StatInit(WDOG_STAT *st);
+void StatAdd(WDOG_STAT *st, u_int32 val);
+u_int32 StatPct(const WDOG_STAT *st, u_int32 pct);
+void StatPrint(const char *name, const WDOG_STAT *st);
+
+/* wdog_ctrl_sched.c */
+int SchedLoad(WDOG_SCHED *sc, const char *file);
+int SchedRun(WDOG_SCHED *sc, int32 verbose);
+void SchedExit(WDOG_SCHED *sc);
+
+/* wdog_ctrl_ho.c */
+int HoSockListen(const char *path, int backlog, const char *what);
+int HoSockPeer(int fd);
+int HoListen(const char *path);
+int HoAccept(int lfd);
+int HoHandOver(int cfd, WDOG_LOOP *lp, u_int64 lastTrig, u_int64 next);
+int HoConnect(WDOG_LOOP *lp);
+void HoConfirm(WDOG_LOOP *lp, u_int64 trig);
+
+/* wdog_ctrl_perf.c */
+int PerfInit(WDOG_PERF *pf, const char *file);
+void PerfMark(WDOG_PERF *pf);
+void PerfPhase(WDOG_PERF *pf, int phase);
+void PerfPass(WDOG_PERF *pf, u_int32 pass, u_int64 deadline);
+void PerfExit(WDOG_PERF *pf);
+
+/* wdog_ctrl_rec.c */
+int RecInit(WDOG_REC *rec, const char *file, const char *device);
+void RecStart(WDOG_REC *rec, int32 trigT, int32 takeover);
+void RecAdd(WDOG_REC *rec, int kind, u_int32 pass, int32 result, int32 arg);
+void RecExit(WDOG_REC *rec);
+int RecDecode(const char *file, const char *device, int32 verbose);
+
+/* wdog_ctrl_gate.c */
+int GateInit(WDOG_GATE *g, const char *file);
+int GateOpen(WDOG_GATE *g);
+void GateExit(WDOG_GATE *g);
+
+/* wdog_ctrl_auto.c */
+int AutoInit(WDOG_AUTO *au, int32 margin, int32 *trigT);
+int32 AutoPass(WDOG_AUTO *au, u_int32 lat);
+void AutoExit(WDOG_AUTO *au);
+
+/* wdog_ctrl_cap.c */
+void CapInit(WDOG_CAP *cap, const char *device, int32 reprobe);
+int CapHas(int32 code, int32 set);
+int CapCheck(const char *opt, int32 code, int32 val);
+int CapMaxTime(int32 *maxT);
+
+/* wdog_ctrl_ctl.c */
+int CtlInit(WDOG_CTL *ctl, const char *path);
+int CtlStart(WDOG_CTL *ctl, WDOG_EVT *evt);
+int CtlApply(WDOG_CTL *ctl, WDOG_LOOP *lp);
+void CtlExit(WDOG_CTL *ctl, int unlinkPath);
+
+/* wdog_ctrl_meas.c */
+int MeasureTimeout(int32 rounds, int32 verbose);
+
+#endif /* _WDOG_CTRL_INT_H */
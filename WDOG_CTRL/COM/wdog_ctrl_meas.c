@@ -0,0 +1,170 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_MEAS                    ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_meas.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Measure real watchdog timeout by polling the pins (-M)
+ *
+ *               Each round triggers once, then polls WDOG_OUT_PIN (and
+ *               WDOG_IRQ_PIN if WDOG_TIME_IRQ is set) as fast as
+ *               possible until the out pin asserts. The time from the
+ *               trigger to the assertion is the real timeout. Then
+ *               WDOG_RESET_CTRL re-arms the watchdog for the next round.
+ *
+ *               Only useful on boards where the output pin does not
+ *               reset the system.
+ *
+ *    \switches  (none)
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+/***************************************************************************/
+/** Print measured timeout against configured one
+ *
+ *  \param name       \IN  name of the timeout
+ *  \param cfg        \IN  configured timeout [us]
+ *  \param st         \IN  measured timeouts
+ */
+static void MeasPrint(const char *name, u_int32 cfg, const WDOG_STAT *st)
+{
+	StatPrint(name, st);
+	if (st->count)
+		printf("%-22s  configured %uus, error min=%+dus p50=%+dus max=%+dus\n",
+			"", cfg, (int32)(st->min - cfg), (int32)(StatPct(st, 5000) - cfg),
+			(int32)(st->max - cfg));
+}
+
+/***************************************************************************/
+/** Measure real out/irq timeout
+ *
+ *  \param rounds     \IN  number of measurements
+ *  \param verbose    \IN  print each measurement
+ *
+ *  \return           success (0) or error code
+ */
+int MeasureTimeout(int32 rounds, int32 verbose)
+{
+	WDOG_STAT outSt, irqSt, pollSt;
+	u_int64 trig, now, last, limit, irqAt;
+	u_int32 polls, missed = 0;
+	int32 maxT, irqT = 0, outPin, irqPin, round;
+	int ret = ERR_OK;
+
+	/* configured times [us] */
+	if (CapMaxTime(&maxT) < 0)
+		return PrintError("getstat WDOG_TIME");
+	if (!CapHas(WDOG_TIME_IRQ, 0) || (M_getstat(G_path, WDOG_TIME_IRQ, &irqT) < 0))
+		irqT = 0;
+	if (maxT <= 0) {
+		printf("*** -M requires a max time (-u)\n");
+		return ERR_PARAM;
+	}
+
+	StatInit(&outSt);
+	StatInit(&irqSt);
+	StatInit(&pollSt);
+
+	if ((M_setstat(G_path, WDOG_START, 0)) < 0)
+		return PrintError("setstat WDOG_START");
+	printf("Measure timeout (max %dus, irq %dus), %d rounds\n", maxT, irqT, rounds);
+
+	for (round = 1; round <= rounds; round++) {
+		/* re-arm: reset counter and pins, then trigger */
+		M_setstat(G_path, WDOG_OUT_REASON, 0);
+		M_setstat(G_path, WDOG_IRQ_REASON, 0);
+		if ((M_setstat(G_path, WDOG_RESET_CTRL, 0)) < 0) {
+			ret = PrintError("setstat WDOG_RESET_CTRL");
+			break;
+		}
+		if ((M_setstat(G_path, WDOG_TRIG, 0)) < 0) {
+			ret = PrintError("setstat WDOG_TRIG");
+			break;
+		}
+		trig = last = NowUs();
+		limit = trig + 2 * (u_int64)maxT + 1000000;
+		irqAt = 0;
+		polls = 0;
+
+		/* busy poll until out pin asserts */
+		for (;;) {
+			if ((M_getstat(G_path, WDOG_OUT_PIN, &outPin)) < 0) {
+				ret = PrintError("getstat WDOG_OUT_PIN");
+				goto EXIT;
+			}
+			/* out pin time before the irq pin read */
+			now = NowUs();
+			if (irqT && !irqAt) {
+				if ((M_getstat(G_path, WDOG_IRQ_PIN, &irqPin)) == 0 && irqPin)
+					irqAt = NowUs();
+			}
+			StatAdd(&pollSt, (u_int32)(now - last));
+			last = now;
+			polls++;
+
+			if (outPin || now > limit)
+				break;
+		}
+
+		if (!outPin) {
+			missed++;
+			printf("*** round %d: out pin not asserted within %lluus\n",
+				round, (unsigned long long)(now - trig));
+			continue;
+		}
+
+		StatAdd(&outSt, (u_int32)(now - trig));
+		if (irqAt)
+			StatAdd(&irqSt, (u_int32)(irqAt - trig));
+
+		if (verbose)
+			printf("#%06d: out after %uus, irq after %uus, %u polls\n",
+				round, (u_int32)(now - trig),
+				irqAt ? (u_int32)(irqAt - trig) : 0, polls);
+	}
+
+EXIT:
+	M_setstat(G_path, WDOG_RESET_CTRL, 0);
+	if ((M_setstat(G_path, WDOG_STOP, 0)) < 0)
+		ret = PrintError("setstat WDOG_STOP");
+
+	MeasPrint("out timeout", (u_int32)maxT, &outSt);
+	if (irqT)
+		MeasPrint("irq timeout", (u_int32)irqT, &irqSt);
+	StatPrint("poll interval", &pollSt);
+	if (missed)
+		printf("*** %u rounds without out pin assertion\n", missed);
+
+	return ret;
+}
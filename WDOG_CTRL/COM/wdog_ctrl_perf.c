@@ -0,0 +1,358 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_PERF                    ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_perf.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Performance counters per trigger pass (-K)
+ *
+ *               Opens cycles, instructions, context switches, page
+ *               faults and CPU migrations of the trigger thread as one
+ *               perf_event group, so each sample is one read(). Each
+ *               pass is split into two phases:
+ *
+ *               - wait: from the end of the last trigger until the
+ *                 deadline (sleep, spin, output)
+ *               - trig: the WDOG_TRIG/WDOG_TRIG_PAT setstat (with -V
+ *                 including its output)
+ *
+ *               A pass is slow if its wakeup lateness or trigger time
+ *               exceeds 4 times the median (at least 200us/100us). The
+ *               counter deltas then name the likely cause: migrated,
+ *               page fault, preempted (context switch besides the
+ *               sleep), slow in the driver or late wakeup.
+ *
+ *               Each pass is one line in the record file:
+ *
+ *               <pass> <late> <trig> <cause> <wait counters> <trig counters>
+ *
+ *               with times in us and counters in the order cycles,
+ *               instructions, context switches, faults, migrations.
+ *               Counters the system doesn't provide (e.g. hardware
+ *               counters in a VM) are 0.
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#ifdef LINUX
+#	include <errno.h>
+#	include <unistd.h>
+#	include <sys/syscall.h>
+#	include <linux/perf_event.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include "wdog_ctrl_int.h"
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define PERF_LATE_MIN	200	/**< min. lateness of a slow pass [us] */
+#define PERF_TRIG_MIN	100	/**< min. trigger time of a slow pass [us] */
+#define PERF_THR_UPD	64	/**< passes between threshold updates */
+
+/*--------------------------------------+
+|   GLOBALS                             |
++--------------------------------------*/
+static const char *G_perfCause[PERF_CAUSES] = {
+	"ok", "preempt", "migr", "fault", "drv", "late"
+};
+
+#ifdef LINUX
+
+static const struct {
+	u_int32 type;
+	u_int64 config;
+	const char *name;
+} G_perfEvt[PERF_EVENTS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,        "cycles" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,      "instructions" },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,  "context-switches" },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,       "page-faults" },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,    "cpu-migrations" },
+};
+
+/***************************************************************************/
+/** Open one counter of the calling thread
+ *
+ *  Counts kernel time too (driver), falls back to user only if
+ *  perf_event_paranoid doesn't allow it.
+ *
+ *  \param i          \IN  counter index
+ *  \param group      \IN  group leader fd or -1
+ *
+ *  \return           fd or -1
+ */
+static int PerfOpen(int i, int group)
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = G_perfEvt[i].type;
+	attr.config = G_perfEvt[i].config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_hv = 1;
+
+	fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group,
+					  PERF_FLAG_FD_CLOEXEC);
+	if ((fd < 0) && ((errno == EACCES) || (errno == EPERM))) {
+		attr.exclude_kernel = 1;
+		fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group,
+						  PERF_FLAG_FD_CLOEXEC);
+	}
+	return fd;
+}
+
+/***************************************************************************/
+/** Read all counters of the group
+ *
+ *  \param pf         \IN  perf state
+ *  \param val        \OUT counter values, unavailable ones 0
+ */
+static void PerfRead(WDOG_PERF *pf, u_int64 *val)
+{
+	u_int64 buf[1 + PERF_EVENTS];
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	if (read(pf->fd[pf->lead], buf, sizeof(buf)) < (ssize_t)sizeof(u_int64))
+		buf[0] = 0;
+
+	for (i = 0; i < PERF_EVENTS; i++)
+		val[i] = ((pf->idx[i] >= 0) && ((u_int64)pf->idx[i] < buf[0])) ?
+			buf[1 + pf->idx[i]] : 0;
+}
+
+/***************************************************************************/
+/** Open counters and record file
+ *
+ *  \param pf         \OUT perf state
+ *  \param file       \IN  record file
+ *
+ *  \return           success (0) or error code
+ */
+int PerfInit(WDOG_PERF *pf, const char *file)
+{
+	int i, n = 0;
+
+	memset(pf, 0, sizeof(*pf));
+	pf->lead = -1;
+	for (i = 0; i < PERF_EVENTS; i++) {
+		pf->fd[i] = PerfOpen(i, pf->lead >= 0 ? pf->fd[pf->lead] : -1);
+		pf->idx[i] = -1;
+		if (pf->fd[i] < 0) {
+			printf("perf counter %s not available (%s)\n",
+				G_perfEvt[i].name, strerror(errno));
+			continue;
+		}
+		if (pf->lead < 0)
+			pf->lead = i;
+		pf->idx[i] = n++;
+	}
+	if (pf->lead < 0) {
+		printf("*** no perf counters (check /proc/sys/kernel/perf_event_paranoid)\n");
+		return ERR_FUNC;
+	}
+
+	if (!(pf->out = fopen(file, "w"))) {
+		printf("*** can't create %s: %s\n", file, strerror(errno));
+		PerfExit(pf);
+		return ERR_FUNC;
+	}
+	fprintf(pf->out, "# pass late trig cause wait:cyc ins csw flt mig trig:cyc ins csw flt mig\n");
+
+	StatInit(&pf->lateSt);
+	StatInit(&pf->trigSt);
+	pf->lateThr = PERF_LATE_MIN;
+	pf->trigThr = PERF_TRIG_MIN;
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Start a pass: take counters at the end of the last trigger
+ *
+ *  \param pf         \IN  perf state
+ */
+void PerfMark(WDOG_PERF *pf)
+{
+	PerfRead(pf, pf->mark);
+	pf->markT = NowUs();
+}
+
+/***************************************************************************/
+/** End a phase: get counter deltas since the last mark
+ *
+ *  \param pf         \IN  perf state
+ *  \param phase      \IN  PERF_WAIT or PERF_TRIG
+ */
+void PerfPhase(WDOG_PERF *pf, int phase)
+{
+	u_int64 val[PERF_EVENTS];
+	int i;
+
+	PerfRead(pf, val);
+	for (i = 0; i < PERF_EVENTS; i++) {
+		pf->delta[phase][i] = val[i] - pf->mark[i];
+		pf->mark[i] = val[i];
+	}
+	pf->markT = pf->phaseT[phase] = NowUs();
+}
+
+#else /* !LINUX */
+
+/***************************************************************************/
+/** Open counters - not supported
+ *
+ *  \return           ERR_PARAM
+ */
+int PerfInit(WDOG_PERF *pf, const char *file)
+{
+	memset(pf, 0, sizeof(*pf));
+	printf("*** -K not supported on this system\n");
+	return ERR_PARAM;
+}
+
+/***************************************************************************/
+/** Start a pass - not supported
+ */
+void PerfMark(WDOG_PERF *pf)
+{
+}
+
+/***************************************************************************/
+/** End a phase - not supported
+ */
+void PerfPhase(WDOG_PERF *pf, int phase)
+{
+}
+
+#endif /* LINUX */
+
+/***************************************************************************/
+/** Get cause of a slow pass from the counter deltas
+ *
+ *  A context switch is expected in the wait phase (sleep), but not
+ *  in the trigger phase.
+ *
+ *  \param pf         \IN  perf state
+ *  \param slowTrig   \IN  trigger phase was slow
+ *
+ *  \return           PERF_CAUSE_xxx
+ */
+static int PerfCause(WDOG_PERF *pf, int slowTrig)
+{
+	u_int64 *w = pf->delta[PERF_WAIT];
+	u_int64 *t = pf->delta[PERF_TRIG];
+
+	if (w[PERF_MIGR] || t[PERF_MIGR])
+		return PERF_CAUSE_MIGR;
+	if (t[PERF_FAULTS] || (!slowTrig && w[PERF_FAULTS]))
+		return PERF_CAUSE_FAULT;
+	if (t[PERF_CSW] || (!slowTrig && w[PERF_CSW] > 1))
+		return PERF_CAUSE_PREEMPT;
+	return slowTrig ? PERF_CAUSE_DRV : PERF_CAUSE_LATE;
+}
+
+/***************************************************************************/
+/** End a pass: classify it and write its record
+ *
+ *  \param pf         \IN  perf state
+ *  \param pass       \IN  pass number
+ *  \param deadline   \IN  deadline of the pass [us]
+ */
+void PerfPass(WDOG_PERF *pf, u_int32 pass, u_int64 deadline)
+{
+	u_int64 *w = pf->delta[PERF_WAIT];
+	u_int64 *t = pf->delta[PERF_TRIG];
+	u_int32 late, trig;
+	int cause = PERF_CAUSE_OK;
+
+	late = pf->phaseT[PERF_WAIT] > deadline ?
+		(u_int32)(pf->phaseT[PERF_WAIT] - deadline) : 0;
+	trig = (u_int32)(pf->phaseT[PERF_TRIG] - pf->phaseT[PERF_WAIT]);
+	StatAdd(&pf->lateSt, late);
+	StatAdd(&pf->trigSt, trig);
+
+	/* slow: above 4 * median */
+	if (!(pass % PERF_THR_UPD)) {
+		pf->lateThr = 4 * StatPct(&pf->lateSt, 5000);
+		pf->trigThr = 4 * StatPct(&pf->trigSt, 5000);
+		if (pf->lateThr < PERF_LATE_MIN)
+			pf->lateThr = PERF_LATE_MIN;
+		if (pf->trigThr < PERF_TRIG_MIN)
+			pf->trigThr = PERF_TRIG_MIN;
+	}
+	if (trig > pf->trigThr)
+		cause = PerfCause(pf, 1);
+	else if (late > pf->lateThr)
+		cause = PerfCause(pf, 0);
+	pf->cause[cause]++;
+
+	if (pf->out)
+		fprintf(pf->out, "%u %u %u %s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
+			pass, late, trig, G_perfCause[cause],
+			(unsigned long long)w[PERF_CYCLES], (unsigned long long)w[PERF_INSTR],
+			(unsigned long long)w[PERF_CSW], (unsigned long long)w[PERF_FAULTS],
+			(unsigned long long)w[PERF_MIGR],
+			(unsigned long long)t[PERF_CYCLES], (unsigned long long)t[PERF_INSTR],
+			(unsigned long long)t[PERF_CSW], (unsigned long long)t[PERF_FAULTS],
+			(unsigned long long)t[PERF_MIGR]);
+}
+
+/***************************************************************************/
+/** Print summary, close counters and record file
+ *
+ *  \param pf         \IN  perf state
+ */
+void PerfExit(WDOG_PERF *pf)
+{
+	int i;
+
+	if (pf->lateSt.count) {
+		StatPrint("wakeup lateness", &pf->lateSt);
+		StatPrint("trigger time", &pf->trigSt);
+		printf("%-22s:", "slow passes by cause");
+		for (i = 1; i < PERF_CAUSES; i++)
+			printf(" %s=%u", G_perfCause[i], pf->cause[i]);
+		printf("\n");
+	}
+
+	if (pf->out)
+		fclose(pf->out);
+	pf->out = NULL;
+#ifdef LINUX
+	for (i = 0; i < PERF_EVENTS; i++)
+		if (pf->fd[i] >= 0)
+			close(pf->fd[i]);
+#endif
+	pf->lead = -1;
+}
@@ -0,0 +1,522 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_REC                     ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_rec.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Flight recorder of the trigger loop (-f/-F)
+ *
+ *               -f=<file> records the trigger loop into a preallocated,
+ *               memory-mapped ring of REC_ENTRIES fixed-size entries:
+ *               start, each trigger with interval, margin to the max.
+ *               time and setstat result, irq signals, faults and stop.
+ *               An entry is a few stores into the mapping, no syscall,
+ *               so recording doesn't change the trigger latency. A
+ *               separate thread writes the mapping to disk with
+ *               msync(MS_SYNC) each REC_SYNC_MS, so after a watchdog
+ *               reset at most the last REC_SYNC_MS are lost.
+ *
+ *               Entries are claimed with an atomic increment of the
+ *               head counter and marked valid by writing their sequence
+ *               number last, so the irq signal handler can record too
+ *               and torn entries are detected when decoding.
+ *
+ *               An existing recording is kept as <file>.old.
+ *
+ *               -F=<file> decodes the recording after the next start and
+ *               correlates it with WDOG_SHOT/WDOG_OUT_REASON/
+ *               WDOG_IRQ_REASON of the device and the boot id.
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef LINUX
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <time.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+#ifdef LINUX
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define REC_MAGIC		"WDOGREC1"
+#define REC_SYNC_MS		1000	/**< msync interval [ms] */
+#define REC_SHOW		32		/**< entries shown by -F without -V */
+#define REC_BOOT_ID		"/proc/sys/kernel/random/boot_id"
+
+/*--------------------------------------+
+|   GLOBALS                             |
++--------------------------------------*/
+static const char *G_recKind[] = {
+	"?", "start", "trig", "irq", "fault", "stop", "handover", "gated"
+};
+
+/***************************************************************************/
+/** Read boot id
+ *
+ *  \param id         \OUT boot id, empty if unknown
+ *  \param size       \IN  size of id
+ */
+static void RecBootId(char *id, int size)
+{
+	FILE *fp;
+
+	memset(id, 0, size);
+	if ((fp = fopen(REC_BOOT_ID, "r"))) {
+		if (fgets(id, size, fp))
+			id[strcspn(id, "\n")] = '\0';
+		fclose(fp);
+	}
+}
+
+/***************************************************************************/
+/** Sync thread: write mapping to disk periodically
+ *
+ *  \param arg        \IN  recorder
+ *
+ *  \return           NULL
+ */
+static void *RecSyncThread(void *arg)
+{
+	WDOG_REC *rec = (WDOG_REC*)arg;
+	struct timespec ts;
+
+	pthread_mutex_lock(&rec->lock);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	while (!rec->stop) {
+		ts.tv_sec += REC_SYNC_MS / 1000;
+		ts.tv_nsec += (REC_SYNC_MS % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		if (pthread_cond_timedwait(&rec->cond, &rec->lock, &ts) == ETIMEDOUT) {
+			pthread_mutex_unlock(&rec->lock);
+			msync(rec->hdr, rec->size, MS_SYNC);
+			pthread_mutex_lock(&rec->lock);
+		}
+	}
+	pthread_mutex_unlock(&rec->lock);
+	return NULL;
+}
+
+/***************************************************************************/
+/** Create recorder file, keep existing one as <file>.old
+ *
+ *  \param rec        \OUT recorder
+ *  \param file       \IN  recorder file
+ *  \param device     \IN  device name
+ *
+ *  \return           success (0) or error code
+ */
+int RecInit(WDOG_REC *rec, const char *file, const char *device)
+{
+	pthread_condattr_t ca;
+	sigset_t mask, oldMask;
+	struct timespec mono, real;
+	char old[256];
+	int fd, err;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->size = sizeof(WDOG_REC_HDR) + REC_ENTRIES * sizeof(WDOG_REC_ENT);
+
+	snprintf(old, sizeof(old), "%s.old", file);
+	if ((access(file, F_OK) == 0) && (rename(file, old) == 0))
+		printf("previous recording kept as %s\n", old);
+
+	if ((fd = open(file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+		printf("*** can't create %s: %s\n", file, strerror(errno));
+		return ERR_FUNC;
+	}
+	/* allocate blocks now, msync must not fail with ENOSPC later */
+	if ((err = posix_fallocate(fd, 0, rec->size)) != 0) {
+		printf("*** can't allocate %s: %s\n", file, strerror(err));
+		close(fd);
+		return ERR_FUNC;
+	}
+	rec->hdr = mmap(NULL, rec->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (rec->hdr == MAP_FAILED) {
+		printf("*** can't map %s: %s\n", file, strerror(errno));
+		rec->hdr = NULL;
+		return ERR_FUNC;
+	}
+	rec->ent = (WDOG_REC_ENT*)(rec->hdr + 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &real);
+	memcpy(rec->hdr->magic, REC_MAGIC, sizeof(rec->hdr->magic));
+	rec->hdr->entSize = sizeof(WDOG_REC_ENT);
+	rec->hdr->nEnt = REC_ENTRIES;
+	rec->hdr->pid = (int32)getpid();
+	rec->hdr->monoStart = (u_int64)mono.tv_sec * 1000000 + mono.tv_nsec / 1000;
+	rec->hdr->realStart = (u_int64)real.tv_sec * 1000000 + real.tv_nsec / 1000;
+	RecBootId(rec->hdr->bootId, sizeof(rec->hdr->bootId));
+	strncpy(rec->hdr->device, device, sizeof(rec->hdr->device) - 1);
+	msync(rec->hdr, rec->size, MS_SYNC);
+
+	pthread_mutex_init(&rec->lock, NULL);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_init(&rec->cond, &ca);
+	pthread_condattr_destroy(&ca);
+
+	/* signals (SIGTERM, irq signal) stay with the trigger thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &oldMask);
+	err = pthread_create(&rec->thr, NULL, RecSyncThread, rec);
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+	if (err != 0) {
+		printf("*** can't create sync thread: %s\n", strerror(err));
+		munmap(rec->hdr, rec->size);
+		rec->hdr = NULL;
+		return ERR_FUNC;
+	}
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Record start of the trigger loop
+ *
+ *  Gets the max. time for the margin of each trigger.
+ *
+ *  \param rec        \IN  recorder
+ *  \param trigT      \IN  trigger period [ms]
+ *  \param takeover   \IN  loop taken over from old instance
+ */
+void RecStart(WDOG_REC *rec, int32 trigT, int32 takeover)
+{
+	int32 maxT;
+
+	if (CapMaxTime(&maxT) < 0)
+		maxT = 0;
+	rec->hdr->trigT = trigT;
+	rec->hdr->maxT = maxT;
+	rec->lastTrig = NowUs();
+	RecAdd(rec, REC_START, 0, 0, takeover);
+}
+
+/***************************************************************************/
+/** Add entry
+ *
+ *  Lock-free and async-signal-safe. For REC_TRIG and REC_IRQ the time
+ *  since the last trigger and the margin to the max. time are stored.
+ *
+ *  \param rec        \IN  recorder
+ *  \param kind       \IN  REC_xxx
+ *  \param pass       \IN  pass number
+ *  \param result     \IN  setstat result (0 or MDIS error code)
+ *  \param arg        \IN  kind specific (fault kind, takeover)
+ */
+void RecAdd(WDOG_REC *rec, int kind, u_int32 pass, int32 result, int32 arg)
+{
+	WDOG_REC_ENT *e;
+	u_int32 slot;
+	u_int64 now = NowUs();
+
+	slot = __sync_fetch_and_add(&rec->hdr->head, 1);
+	e = &rec->ent[slot % REC_ENTRIES];
+	e->seq = 0;
+	__sync_synchronize();
+
+	e->t = now;
+	e->pass = pass;
+	e->kind = (u_int16)kind;
+	e->arg = (u_int16)arg;
+	e->result = result;
+	e->interval = (u_int32)(now - rec->lastTrig);
+	e->margin = rec->hdr->maxT ? rec->hdr->maxT - (int32)e->interval : 0;
+	if ((kind == REC_TRIG) && !result)
+		rec->lastTrig = now;
+
+	__sync_synchronize();
+	e->seq = slot + 1;
+}
+
+/***************************************************************************/
+/** Stop sync thread, write and unmap recording
+ *
+ *  \param rec        \IN  recorder
+ */
+void RecExit(WDOG_REC *rec)
+{
+	if (!rec->hdr)
+		return;
+
+	pthread_mutex_lock(&rec->lock);
+	rec->stop = 1;
+	pthread_cond_signal(&rec->cond);
+	pthread_mutex_unlock(&rec->lock);
+	pthread_join(rec->thr, NULL);
+	pthread_cond_destroy(&rec->cond);
+	pthread_mutex_destroy(&rec->lock);
+
+	msync(rec->hdr, rec->size, MS_SYNC);
+	munmap(rec->hdr, rec->size);
+	rec->hdr = NULL;
+}
+
+/***************************************************************************/
+/** Format monotonic time of recording as wall clock time
+ *
+ *  \param hdr        \IN  recorder header
+ *  \param t          \IN  time [us, monotonic]
+ *  \param buf        \OUT string
+ *  \param size       \IN  size of buf
+ *
+ *  \return           buf
+ */
+static char *RecTime(const WDOG_REC_HDR *hdr, u_int64 t, char *buf, int size)
+{
+	u_int64 real = hdr->realStart + (t - hdr->monoStart);
+	time_t sec = (time_t)(real / 1000000);
+	struct tm tm;
+	int n;
+
+	localtime_r(&sec, &tm);
+	n = (int)strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+	snprintf(buf + n, size - n, ".%06u", (u_int32)(real % 1000000));
+	return buf;
+}
+
+/***************************************************************************/
+/** Read device state the recording is correlated with
+ *
+ *  \param device     \IN  device name
+ *  \param shot       \OUT WDOG_SHOT or -1
+ *  \param outR       \OUT WDOG_OUT_REASON or -1
+ *  \param irqR       \OUT WDOG_IRQ_REASON or -1
+ */
+static void RecDevState(const char *device, int32 *shot, int32 *outR, int32 *irqR)
+{
+	MDIS_PATH path;
+
+	*shot = *outR = *irqR = -1;
+	if ((path = M_open(device)) < 0) {
+		printf("*** can't open %s: %s - no correlation with device state\n",
+			device, M_errstring(UOS_ErrnoGet()));
+		return;
+	}
+	M_getstat(path, WDOG_SHOT, shot);
+	M_getstat(path, WDOG_OUT_REASON, outR);
+	M_getstat(path, WDOG_IRQ_REASON, irqR);
+	M_close(path);
+}
+
+/***************************************************************************/
+/** Decode recording and correlate it with the device state
+ *
+ *  \param file       \IN  recorder file
+ *  \param device     \IN  device name
+ *  \param verbose    \IN  show all entries instead of the last REC_SHOW
+ *
+ *  \return           success (0) or error code
+ */
+int RecDecode(const char *file, const char *device, int32 verbose)
+{
+	WDOG_REC_HDR *hdr = NULL;
+	WDOG_REC_ENT *e, *last = NULL, *lastTrig = NULL;
+	WDOG_STAT intSt;
+	char boot[40], tbuf[40];
+	u_int32 i, first, n, torn = 0, errs = 0, irqs = 0, faults = 0;
+	int32 minMargin = 0x7fffffff, shot, outR, irqR, clean;
+	long size;
+	FILE *fp;
+	int ret = ERR_FUNC;
+
+	if (!(fp = fopen(file, "rb"))) {
+		printf("*** can't open %s: %s\n", file, strerror(errno));
+		return ERR_FUNC;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	rewind(fp);
+	if ((size < (long)sizeof(WDOG_REC_HDR)) || !(hdr = malloc(size)) ||
+		(fread(hdr, 1, size, fp) != (size_t)size) ||
+		memcmp(hdr->magic, REC_MAGIC, sizeof(hdr->magic)) ||
+		(hdr->entSize != sizeof(WDOG_REC_ENT)) ||
+		(size < (long)(sizeof(WDOG_REC_HDR) + hdr->nEnt * sizeof(WDOG_REC_ENT)))) {
+		printf("*** %s is no flight recording\n", file);
+		goto EXIT;
+	}
+	e = (WDOG_REC_ENT*)(hdr + 1);
+
+	RecBootId(boot, sizeof(boot));
+	printf("Flight recording %s: %s, pid %d, trigger %dms, max. time %dus\n",
+		file, hdr->device, hdr->pid, hdr->trigT, hdr->maxT);
+	printf("started %s, %s\n", RecTime(hdr, hdr->monoStart, tbuf, sizeof(tbuf)),
+		!boot[0] || !hdr->bootId[0] ? "boot unknown" :
+		strcmp(boot, hdr->bootId) ? "system rebooted since" : "same boot");
+
+	/* walk ring oldest to newest */
+	n = hdr->head < hdr->nEnt ? hdr->head : hdr->nEnt;
+	first = hdr->head - n;
+	StatInit(&intSt);
+	for (i = first; i != hdr->head; i++) {
+		WDOG_REC_ENT *r = &e[i % hdr->nEnt];
+
+		if (r->seq != i + 1) {
+			torn++;
+			continue;
+		}
+		last = r;
+		switch (r->kind) {
+		case REC_TRIG:
+			if (r->result) {
+				errs++;
+				break;
+			}
+			lastTrig = r;
+			if (r->pass > 1)
+				StatAdd(&intSt, r->interval);
+			if (hdr->maxT && (r->margin < minMargin))
+				minMargin = r->margin;
+			break;
+		case REC_IRQ:
+			irqs++;
+			break;
+		case REC_FAULT:
+			faults++;
+			break;
+		}
+
+		if (!verbose && (hdr->head - i > REC_SHOW))
+			continue;
+		printf("%s %-8s #%06u +%8uus margin %+8dus",
+			RecTime(hdr, r->t, tbuf, sizeof(tbuf)),
+			r->kind < sizeof(G_recKind) / sizeof(*G_recKind) ?
+			G_recKind[r->kind] : "?", r->pass, r->interval, r->margin);
+		if (r->result)
+			printf(" error %s", M_errstring(r->result));
+		if (r->arg)
+			printf(" arg %u", r->arg);
+		printf("\n");
+	}
+
+	printf("%u entries (%u total), %u torn, %u setstat errors, %u irq signals, %u faults\n",
+		n, hdr->head, torn, errs, irqs, faults);
+	StatPrint("trigger interval", &intSt);
+	if (minMargin != 0x7fffffff)
+		printf("%-22s: %dus\n", "min. margin", minMargin);
+
+	/*----------------------+
+	|  correlate            |
+	+----------------------*/
+	RecDevState(device, &shot, &outR, &irqR);
+	printf("%s: WDOG_SHOT=%d WDOG_OUT_REASON=%d WDOG_IRQ_REASON=%d\n",
+		device, shot, outR, irqR);
+
+	clean = last && ((last->kind == REC_STOP) || (last->kind == REC_HANDOVER));
+	if (clean)
+		printf("=> recording ended with %s, the trigger loop is not the cause\n",
+			G_recKind[last->kind]);
+	else if (!lastTrig)
+		printf("=> recording ended before the first trigger\n");
+	else {
+		printf("=> recording ended without stop, last trigger %s\n",
+			RecTime(hdr, lastTrig->t, tbuf, sizeof(tbuf)));
+		if (hdr->maxT)
+			printf("   expiry expected at %s\n",
+				RecTime(hdr, lastTrig->t + hdr->maxT, tbuf, sizeof(tbuf)));
+		if (outR == 2 || shot == 1)
+			printf("   watchdog fired by max. timeout: trigger loop stopped "
+				   "(killed, hung or system stall) after the last trigger\n");
+		else if (outR == 1)
+			printf("   watchdog fired by min. timeout: trigger too early, "
+				   "shortest interval %uus\n", intSt.min);
+		else if (errs)
+			printf("   last trigger(s) failed in the driver\n");
+		else if (outR == 0)
+			printf("   watchdog didn't fire: process killed or reset by other cause\n");
+	}
+	ret = ERR_OK;
+
+EXIT:
+	free(hdr);
+	fclose(fp);
+	return ret;
+}
+
+#else /* !LINUX */
+
+/***************************************************************************/
+/** Create recorder file - not supported
+ *
+ *  \return           ERR_PARAM
+ */
+int RecInit(WDOG_REC *rec, const char *file, const char *device)
+{
+	printf("*** -f not supported on this system\n");
+	return ERR_PARAM;
+}
+
+/***************************************************************************/
+/** Record start of the trigger loop - not supported
+ */
+void RecStart(WDOG_REC *rec, int32 trigT, int32 takeover)
+{
+}
+
+/***************************************************************************/
+/** Add entry - not supported
+ */
+void RecAdd(WDOG_REC *rec, int kind, u_int32 pass, int32 result, int32 arg)
+{
+}
+
+/***************************************************************************/
+/** Release recorder - not supported
+ */
+void RecExit(WDOG_REC *rec)
+{
+}
+
+/***************************************************************************/
+/** Decode recording - not supported
+ *
+ *  \return           ERR_PARAM
+ */
+int RecDecode(const char *file, const char *device, int32 verbose)
+{
+	printf("*** -F not supported on this system\n");
+	return ERR_PARAM;
+}
+
+#endif /* LINUX */
@@ -0,0 +1,517 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_SCHED                   ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_sched.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Trigger schedule scripts for test benches (-s)
+ *
+ *               A script is compiled completely into a flat action
+ *               table before the device is touched. Running it needs
+ *               no parsing and no memory allocation. All timed actions
+ *               use absolute deadlines, each one based on the previous
+ *               deadline, so there are no gaps between the steps.
+ *
+ *               Script syntax, one statement per line, '#' comment:
+ *                 max <ms>          set max time (WDOG_TIME_MAX/WDOG_TIME)
+ *                 min <ms>          set min time
+ *                 irq <ms>          set irq time
+ *                 start / stop      start/stop watchdog
+ *                 reset             reset watchdog (counter, pins)
+ *                 clear             clear out/irq reason
+ *                 outpin / irqpin / errpin <0,1>
+ *                                   set/clear pin
+ *                 trig <ms> [<n>]   n triggers, <ms> apart [1]
+ *                 pat <ms> [<n>]    same with alternating pattern
+ *                 ramp <from> <to> <step> [pat]
+ *                                   triggers with increasing interval
+ *                 wait <ms>         wait without trigger
+ *                 expect <code> <op> <val>
+ *                                   getstat WDOG_xxx code and compare,
+ *                                   op: == != < <= > >=
+ *                 info              print watchdog info (as -g)
+ *                 repeat <n> ... end
+ *                                   repeat block n times (nestable)
+ *
+ *    \switches  (none)
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+/* actions */
+#define SCHED_SET		0	/**< setstat code, arg */
+#define SCHED_SETMAX	1	/**< set max time arg [ms] with fallback */
+#define SCHED_WAIT		2	/**< wait arg [ms] */
+#define SCHED_TRIG		3	/**< arg2 triggers arg [ms] apart, pattern: arg3 */
+#define SCHED_RAMP		4	/**< triggers arg..arg2 [ms] step cnt, pattern: arg3 */
+#define SCHED_EXPECT	5	/**< getstat code, compare op arg3 with arg */
+#define SCHED_INFO		6	/**< GetInfo() */
+#define SCHED_REPEAT	7	/**< repeat arg times, arg3: index of END */
+#define SCHED_END		8	/**< arg3: index of REPEAT */
+
+/* compare ops */
+#define SCHED_EQ		0
+#define SCHED_NE		1
+#define SCHED_LT		2
+#define SCHED_LE		3
+#define SCHED_GT		4
+#define SCHED_GE		5
+
+#define SCHED_NEST_MAX	16	/**< max. nesting of repeat */
+
+/*--------------------------------------+
+|   GLOBALS                             |
++--------------------------------------*/
+static const char *G_schedOp[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+/***************************************************************************/
+/** Append action to table
+ *
+ *  \param sc         \INOUT schedule
+ *  \param line       \IN  script line
+ *  \param op         \IN  SCHED_xxx
+ *  \param code       \IN  status code
+ *  \param arg        \IN  argument
+ *  \param arg2       \IN  second argument
+ *  \param arg3       \IN  third argument
+ *
+ *  \return           index of action or -1 on out of memory
+ */
+static int32 SchedAdd(WDOG_SCHED *sc, int32 line, int32 op, int32 code,
+					  int32 arg, int32 arg2, int32 arg3)
+{
+	SCHED_ACT *act;
+
+	if (sc->nActs == sc->alloc) {
+		sc->alloc = sc->alloc ? sc->alloc * 2 : 64;
+		if (!(act = realloc(sc->act, sc->alloc * sizeof(*act))))
+			return -1;
+		sc->act = act;
+	}
+
+	act = &sc->act[sc->nActs];
+	memset(act, 0, sizeof(*act));
+	act->line = line;
+	act->op   = op;
+	act->code = code;
+	act->arg  = arg;
+	act->arg2 = arg2;
+	act->arg3 = arg3;
+	return sc->nActs++;
+}
+
+/***************************************************************************/
+/** Compile one script line
+ *
+ *  \param sc         \INOUT schedule
+ *  \param line       \IN  line number
+ *  \param tok        \IN  tokens
+ *  \param nTok       \IN  number of tokens (>0)
+ *  \param stack      \INOUT open repeat blocks
+ *  \param depth      \INOUT nesting depth
+ *
+ *  \return           0 or -1 on syntax error
+ */
+static int SchedLine(WDOG_SCHED *sc, int32 line, char **tok, int nTok,
+					 int32 *stack, int *depth)
+{
+	const char *cmd = tok[0];
+	int32 a[3] = { 0, 0, 0 }, idx;
+	int n, nNum;
+	char *end;
+
+	/* leading numeric arguments */
+	for (nNum = 0; nNum < nTok - 1 && nNum < 3; nNum++) {
+		a[nNum] = strtol(tok[nNum+1], &end, 0);
+		if (*end)
+			break;
+	}
+
+/* check number of arguments, first <num> of them numeric */
+#define ARGS(min, max, num)	\
+	if (nTok - 1 < (min) || nTok - 1 > (max) || nNum < (num)) return -1
+
+	if (!strcmp(cmd, "max")) {
+		ARGS(1, 1, 1);
+		idx = SchedAdd(sc, line, SCHED_SETMAX, 0, a[0], 0, 0);
+	}
+	else if (!strcmp(cmd, "min")) {
+		ARGS(1, 1, 1);
+		idx = SchedAdd(sc, line, SCHED_SET, WDOG_TIME_MIN, a[0] * 1000, 0, 0);
+	}
+	else if (!strcmp(cmd, "irq")) {
+		ARGS(1, 1, 1);
+		idx = SchedAdd(sc, line, SCHED_SET, WDOG_TIME_IRQ, a[0] * 1000, 0, 0);
+	}
+	else if (!strcmp(cmd, "start")) {
+		ARGS(0, 0, 0);
+		idx = SchedAdd(sc, line, SCHED_SET, WDOG_START, 0, 0, 0);
+	}
+	else if (!strcmp(cmd, "stop")) {
+		ARGS(0, 0, 0);
+		idx = SchedAdd(sc, line, SCHED_SET, WDOG_STOP, 0, 0, 0);
+	}
+	else if (!strcmp(cmd, "reset")) {
+		ARGS(0, 0, 0);
+		idx = SchedAdd(sc, line, SCHED_SET, WDOG_RESET_CTRL, 0, 0, 0);
+	}
+	else if (!strcmp(cmd, "clear")) {
+		ARGS(0, 0, 0);
+		if (SchedAdd(sc, line, SCHED_SET, WDOG_OUT_REASON, 0, 0, 0) < 0)
+			return -1;
+		idx = SchedAdd(sc, line, SCHED_SET, WDOG_IRQ_REASON, 0, 0, 0);
+	}
+	else if (!strcmp(cmd, "outpin") || !strcmp(cmd, "irqpin") ||
+			 !strcmp(cmd, "errpin")) {
+		ARGS(1, 1, 1);
+		idx = SchedAdd(sc, line, SCHED_SET,
+			cmd[0] == 'o' ? WDOG_OUT_PIN : cmd[0] == 'i' ? WDOG_IRQ_PIN :
+			WDOG_ERR_PIN, a[0], 0, 0);
+	}
+	else if (!strcmp(cmd, "trig") || !strcmp(cmd, "pat")) {
+		ARGS(1, 2, nTok - 1);
+		if (a[0] < 0 || (nTok == 3 && a[1] < 1))
+			return -1;
+		sc->usePat |= (cmd[0] == 'p');
+		idx = SchedAdd(sc, line, SCHED_TRIG, 0, a[0], nTok == 3 ? a[1] : 1,
+			cmd[0] == 'p');
+	}
+	else if (!strcmp(cmd, "ramp")) {
+		ARGS(3, 4, 3);
+		if (a[0] < 0 || a[2] == 0 || (a[2] > 0) != (a[1] >= a[0]) ||
+			(nTok == 5 && strcmp(tok[4], "pat")))
+			return -1;
+		sc->usePat |= (nTok == 5);
+		idx = SchedAdd(sc, line, SCHED_RAMP, a[2], a[0], a[1], nTok == 5);
+	}
+	else if (!strcmp(cmd, "wait")) {
+		ARGS(1, 1, 1);
+		idx = SchedAdd(sc, line, SCHED_WAIT, 0, a[0], 0, 0);
+	}
+	else if (!strcmp(cmd, "expect")) {
+		ARGS(3, 3, 0);
+		for (n = 0; n < WDOG_CODES; n++)
+			if (!strcmp(tok[1], G_wdogCode[n].name))
+				break;
+		if (n == WDOG_CODES)
+			return -1;
+		for (idx = SCHED_EQ; idx <= SCHED_GE; idx++)
+			if (!strcmp(tok[2], G_schedOp[idx]))
+				break;
+		if (idx > SCHED_GE)
+			return -1;
+		a[0] = strtol(tok[3], &end, 0);
+		if (*end)
+			return -1;
+		idx = SchedAdd(sc, line, SCHED_EXPECT, G_wdogCode[n].code,
+			a[0], n, idx);
+	}
+	else if (!strcmp(cmd, "info")) {
+		ARGS(0, 0, 0);
+		idx = SchedAdd(sc, line, SCHED_INFO, 0, 0, 0, 0);
+	}
+	else if (!strcmp(cmd, "repeat")) {
+		ARGS(1, 1, 1);
+		if (a[0] < 0 || *depth == SCHED_NEST_MAX)
+			return -1;
+		idx = stack[(*depth)++] = SchedAdd(sc, line, SCHED_REPEAT, 0, a[0], 0, 0);
+	}
+	else if (!strcmp(cmd, "end")) {
+		ARGS(0, 0, 0);
+		if (*depth == 0)
+			return -1;
+		n = stack[--(*depth)];
+		idx = SchedAdd(sc, line, SCHED_END, 0, 0, 0, n);
+		if (idx >= 0)
+			sc->act[n].arg3 = idx;
+	}
+	else
+		return -1;
+
+#undef ARGS
+	return idx < 0 ? -1 : 0;
+}
+
+/***************************************************************************/
+/** Compile schedule script into action table
+ *
+ *  \param sc         \OUT schedule
+ *  \param file       \IN  script file
+ *
+ *  \return           success (0) or error code
+ */
+int SchedLoad(WDOG_SCHED *sc, const char *file)
+{
+	FILE *fp;
+	char buf[256], *tok[6], *p;
+	int32 stack[SCHED_NEST_MAX], line = 0;
+	int nTok, depth = 0;
+
+	memset(sc, 0, sizeof(*sc));
+
+	if (!(fp = fopen(file, "r"))) {
+		printf("*** can't open schedule %s\n", file);
+		return ERR_PARAM;
+	}
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		line++;
+		if ((p = strchr(buf, '#')))
+			*p = '\0';
+
+		for (nTok = 0, p = strtok(buf, " \t\r\n"); p && nTok < 6;
+			 p = strtok(NULL, " \t\r\n"))
+			tok[nTok++] = p;
+		if (!nTok)
+			continue;
+
+		if (SchedLine(sc, line, tok, nTok, stack, &depth) < 0) {
+			printf("*** %s line %d: syntax error\n", file, line);
+			fclose(fp);
+			SchedExit(sc);
+			return ERR_PARAM;
+		}
+	}
+	fclose(fp);
+
+	if (depth) {
+		printf("*** %s: repeat without end\n", file);
+		SchedExit(sc);
+		return ERR_PARAM;
+	}
+
+	printf("Schedule %s: %d lines compiled to %d actions\n", file, line, sc->nActs);
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Wait until next deadline
+ *
+ *  \param sc         \INOUT schedule
+ *  \param evt        \IN  event loop
+ *  \param ms         \IN  time after previous deadline [ms]
+ *
+ *  \return           EVT_TIMER or event that aborted the wait
+ */
+static int SchedWait(WDOG_SCHED *sc, WDOG_EVT *evt, int32 ms)
+{
+	sc->deadline += (u_int64)ms * 1000;
+	EvtArm(evt, sc->deadline, 0);
+	return EvtWait(evt);
+}
+
+/***************************************************************************/
+/** Trigger watchdog
+ *
+ *  \param sc         \INOUT schedule
+ *  \param usePat     \IN  trigger with alternating pattern
+ *
+ *  \return           success (0) or error code
+ */
+static int SchedTrig(WDOG_SCHED *sc, int32 usePat)
+{
+	if (usePat) {
+		if (M_setstat(G_path, WDOG_TRIG_PAT, WDOG_TRIGPAT(sc->patIdx)) < 0)
+			return PrintError("setstat WDOG_TRIG_PAT");
+		sc->patIdx ^= 1;
+	}
+	else if (M_setstat(G_path, WDOG_TRIG, 0) < 0)
+		return PrintError("setstat WDOG_TRIG");
+
+	sc->trigs++;
+	return ERR_OK;
+}
+
+/***************************************************************************/
+/** Run compiled schedule
+ *
+ *  A keypress or SIGTERM/SIGINT aborts the schedule and stops the
+ *  watchdog if the schedule started it.
+ *
+ *  \param sc         \INOUT schedule
+ *  \param verbose    \IN  print each action
+ *
+ *  \return           success (0), ERR_FUNC on error or failed expectation
+ */
+int SchedRun(WDOG_SCHED *sc, int32 verbose)
+{
+	WDOG_EVT evt;
+	SCHED_ACT *act = NULL;
+	int32 pc, i, val, ms, ok;
+	u_int64 start;
+	int ev = EVT_TIMER, ret = ERR_OK;
+
+	if ((ret = EvtInit(&evt)) != ERR_OK)
+		return ret;
+
+	/* continue the pattern sequence of the driver */
+	if (sc->usePat) {
+		if (M_getstat(G_path, WDOG_TRIG_PAT, &val) < 0) {
+			ret = PrintError("getstat WDOG_TRIG_PAT");
+			goto EXIT;
+		}
+		sc->patIdx = (val == WDOG_TRIGPAT(0)) ? 1 : 0;
+	}
+
+	start = sc->deadline = NowUs();
+
+	for (pc = 0; pc < sc->nActs && ev == EVT_TIMER && ret == ERR_OK; ) {
+		act = &sc->act[pc];
+
+		if (verbose)
+			printf("+%8lluus line %3d\n",
+				(unsigned long long)(NowUs() - start), act->line);
+
+		switch (act->op) {
+		case SCHED_SET:
+			if (M_setstat(G_path, act->code, act->arg) < 0) {
+				printf("line %d: ", act->line);
+				ret = PrintError("setstat");
+			}
+			else if (act->code == WDOG_START)
+				sc->started = 1;
+			else if (act->code == WDOG_STOP)
+				sc->started = 0;
+			break;
+
+		case SCHED_SETMAX:
+			if ((!CapHas(WDOG_TIME_MAX, 1) ||
+				 (M_setstat(G_path, WDOG_TIME_MAX, act->arg * 1000) < 0)) &&
+				(M_setstat(G_path, WDOG_TIME, act->arg) < 0)) {
+				printf("line %d: ", act->line);
+				ret = PrintError("setstat WDOG_TIME");
+			}
+			break;
+
+		case SCHED_WAIT:
+			ev = SchedWait(sc, &evt, act->arg);
+			break;
+
+		case SCHED_TRIG:
+			for (i = 0; i < act->arg2 && ev == EVT_TIMER && ret == ERR_OK; i++)
+				if ((ev = SchedWait(sc, &evt, act->arg)) == EVT_TIMER)
+					ret = SchedTrig(sc, act->arg3);
+			break;
+
+		case SCHED_RAMP:
+			for (ms = act->arg;
+				 (act->code > 0 ? ms <= act->arg2 : ms >= act->arg2) &&
+				 ev == EVT_TIMER && ret == ERR_OK; ms += act->code)
+				if ((ev = SchedWait(sc, &evt, ms)) == EVT_TIMER)
+					ret = SchedTrig(sc, act->arg3);
+			break;
+
+		case SCHED_EXPECT:
+			if (M_getstat(G_path, act->code, &val) < 0) {
+				printf("*** line %d: expect %s: ", act->line,
+					G_wdogCode[act->arg2].name);
+				PRINT_ERR
+				sc->failed++;
+				break;
+			}
+			switch (act->arg3) {
+			case SCHED_EQ: ok = (val == act->arg); break;
+			case SCHED_NE: ok = (val != act->arg); break;
+			case SCHED_LT: ok = (val <  act->arg); break;
+			case SCHED_LE: ok = (val <= act->arg); break;
+			case SCHED_GT: ok = (val >  act->arg); break;
+			default:       ok = (val >= act->arg); break;
+			}
+			if (!ok) {
+				printf("*** line %d: expect %s %s %d failed, got %d\n",
+					act->line, G_wdogCode[act->arg2].name,
+					G_schedOp[act->arg3], act->arg, val);
+				sc->failed++;
+			}
+			break;
+
+		case SCHED_INFO:
+			GetInfo();
+			break;
+
+		case SCHED_REPEAT:
+			act->cnt = act->arg;
+			if (act->cnt == 0) {
+				pc = act->arg3 + 1;
+				continue;
+			}
+			break;
+
+		case SCHED_END:
+			if (--sc->act[act->arg3].cnt > 0) {
+				pc = act->arg3 + 1;
+				continue;
+			}
+			break;
+		}
+		pc++;
+	}
+
+	if (ev == EVT_ERR)
+		ret = ERR_FUNC;
+	else if (ev != EVT_TIMER)
+		printf("Schedule aborted at line %d\n", act->line);
+
+	/* don't leave a watchdog running that nobody triggers */
+	if ((ev != EVT_TIMER || ret != ERR_OK) && sc->started) {
+		if (M_setstat(G_path, WDOG_STOP, 0) < 0)
+			ret = PrintError("setstat WDOG_STOP");
+		else
+			printf("Watchdog stopped\n");
+	}
+
+	printf("Schedule done after %llums: %u triggers, %u expectations failed\n",
+		(unsigned long long)((NowUs() - start) / 1000), sc->trigs, sc->failed);
+	if (sc->failed && ret == ERR_OK)
+		ret = ERR_FUNC;
+
+EXIT:
+	EvtExit(&evt);
+	return ret;
+}
+
+/***************************************************************************/
+/** Release schedule
+ *
+ *  \param sc         \IN  schedule
+ */
+void SchedExit(WDOG_SCHED *sc)
+{
+	free(sc->act);
+	sc->act = NULL;
+	sc->nActs = sc->alloc = 0;
+}
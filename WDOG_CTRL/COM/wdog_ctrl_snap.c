@@ -0,0 +1,327 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_SNAP                    ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_snap.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Parallel status snapshot of several WDOG devices (-S)
+ *
+ *               All devices are read concurrently by a bounded pool of
+ *               worker threads. The result is printed as one JSON
+ *               document after all workers are done, so the output
+ *               order does not depend on the worker timing. More than
+ *               SNAP_DEV_MAX devices are dropped, the document then has
+ *               "truncated":true and the exit code is an error.
+ *
+ *    \switches  LINUX
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef LINUX
+#	include <fnmatch.h>
+#	include <pthread.h>
+#	include <time.h>
+#endif
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#include "wdog_ctrl_int.h"
+
+#ifdef LINUX
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#define SNAP_PAT_MAX	32	/**< instances <prefix>1..n tried per pattern */
+#define SNAP_DEV_MAX	256	/**< max. devices per snapshot */
+
+/*--------------------------------------+
+|   TYPDEFS                             |
++--------------------------------------*/
+/** one status code read from a device */
+typedef struct {
+	int32	val;		/**< value */
+	u_int32	err;		/**< MDIS error code, 0=ok */
+} SNAP_VAL;
+
+/** result of one device */
+typedef struct {
+	char	name[40];	/**< device name */
+	int		fromPat;	/**< expanded from pattern (skip if not present) */
+	u_int64	time;		/**< start of read [us, realtime] */
+	u_int32	duration;	/**< duration of read [us] */
+	u_int32	openErr;	/**< M_open error code, 0=ok */
+	SNAP_VAL val[WDOG_CODES];	/**< values in order of G_wdogCode */
+} SNAP_DEV;
+
+/** work shared by the worker threads */
+typedef struct {
+	SNAP_DEV	*dev;
+	int			nDevs;
+	int			next;		/**< next device to read (atomic) */
+} SNAP_WORK;
+
+/***************************************************************************/
+/** Get realtime clock
+ *
+ *  \return           time since epoch [us]
+ */
+static u_int64 RealUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (u_int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/***************************************************************************/
+/** Read all status codes of one device
+ *
+ *  \param dev        \INOUT device
+ */
+static void SnapDevice(SNAP_DEV *dev)
+{
+	MDIS_PATH path;
+	u_int64 start;
+	u_int32 i;
+
+	dev->time = RealUs();
+	start = NowUs();
+
+	if ((path = M_open(dev->name)) < 0) {
+		dev->openErr = UOS_ErrnoGet();
+	}
+	else {
+		for (i = 0; i < WDOG_CODES; i++) {
+			if (M_getstat(path, G_wdogCode[i].code, &dev->val[i].val) < 0)
+				dev->val[i].err = UOS_ErrnoGet();
+		}
+		M_close(path);
+	}
+
+	dev->duration = (u_int32)(NowUs() - start);
+}
+
+/***************************************************************************/
+/** Worker thread: read devices until all are claimed
+ *
+ *  \param arg        \IN  SNAP_WORK
+ *
+ *  \return           NULL
+ */
+static void *SnapWorker(void *arg)
+{
+	SNAP_WORK *work = (SNAP_WORK*)arg;
+	int idx;
+
+	while ((idx = __sync_fetch_and_add(&work->next, 1)) < work->nDevs)
+		SnapDevice(&work->dev[idx]);
+
+	return NULL;
+}
+
+/***************************************************************************/
+/** Add device name, expand pattern
+ *
+ *  MDIS device names can't be listed, so a pattern (containing *?[)
+ *  is matched against <prefix>1..SNAP_PAT_MAX, where <prefix> is the
+ *  part before the first wildcard (e.g. "wdog_*" -> wdog_1..wdog_32).
+ *
+ *  \param dev        \OUT device array
+ *  \param nDevs      \INOUT number of devices
+ *  \param arg        \IN  device name or pattern
+ *
+ *  \return           0 or -1 if devices were dropped (SNAP_DEV_MAX)
+ */
+static int SnapAddDev(SNAP_DEV *dev, int *nDevs, const char *arg)
+{
+	char name[40];
+	size_t pfxLen;
+	int i;
+
+	pfxLen = strcspn(arg, "*?[");
+
+	if (arg[pfxLen] == '\0') {
+		if (*nDevs >= SNAP_DEV_MAX)
+			return -1;
+		strncpy(dev[(*nDevs)++].name, arg, sizeof(dev->name) - 1);
+		return 0;
+	}
+
+	for (i = 1; i <= SNAP_PAT_MAX; i++) {
+		snprintf(name, sizeof(name), "%.*s%d", (int)pfxLen, arg, i);
+		if (fnmatch(arg, name, 0) != 0)
+			continue;
+		if (*nDevs >= SNAP_DEV_MAX)
+			return -1;
+		strcpy(dev[*nDevs].name, name);
+		dev[(*nDevs)++].fromPat = 1;
+	}
+	return 0;
+}
+
+/***************************************************************************/
+/** Print string as JSON string
+ *
+ *  \param str        \IN  string
+ */
+static void JsonStr(const char *str)
+{
+	putchar('"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			printf("\\u%04x", *str);
+		else
+			putchar(*str);
+	}
+	putchar('"');
+}
+
+/***************************************************************************/
+/** Print MDIS error as JSON object
+ *
+ *  \param err        \IN  MDIS error code
+ */
+static void JsonErr(u_int32 err)
+{
+	printf("{\"error\":%u,\"msg\":", err);
+	JsonStr(M_errstring(err));
+	printf("}");
+}
+
+/***************************************************************************/
+/** Read status of all devices in parallel, print JSON document
+ *
+ *  \param argc       \IN  argument counter
+ *  \param argv       \IN  argument vector, all non-option arguments
+ *                         are device names or patterns
+ *  \param nThreads   \IN  max. number of threads incl. the calling one
+ *
+ *  \return           success (0) or error code if a device couldn't be
+ *                    opened or no device was found
+ */
+int Snapshot(int argc, char *argv[], int nThreads)
+{
+	SNAP_WORK work;
+	pthread_t *tid;
+	u_int64 time, start;
+	u_int32 i;
+	int n, started, first, failed = 0, truncated = 0;
+
+	memset(&work, 0, sizeof(work));
+	if (!(work.dev = calloc(SNAP_DEV_MAX, sizeof(SNAP_DEV)))) {
+		printf("*** out of memory\n");
+		return ERR_FUNC;
+	}
+	for (n = 1; n < argc; n++)
+		if (*argv[n] != '-')
+			if (SnapAddDev(work.dev, &work.nDevs, argv[n]) < 0)
+				truncated = 1;
+
+	if (nThreads > work.nDevs)
+		nThreads = work.nDevs;
+	if (nThreads < 1)
+		nThreads = 1;
+	if (!(tid = calloc(nThreads, sizeof(pthread_t)))) {
+		free(work.dev);
+		printf("*** out of memory\n");
+		return ERR_FUNC;
+	}
+
+	time = RealUs();
+	start = NowUs();
+
+	/* the calling thread is one of the readers */
+	for (started = 0; started < nThreads - 1; started++)
+		if (pthread_create(&tid[started], NULL, SnapWorker, &work) != 0)
+			break;
+	SnapWorker(&work);
+	for (n = 0; n < started; n++)
+		pthread_join(tid[n], NULL);
+
+	printf("{\"time\":%llu,\"duration\":%llu,\"threads\":%d,\"devices\":[",
+		(unsigned long long)time, (unsigned long long)(NowUs() - start),
+		started + 1);
+
+	for (first = 1, n = 0; n < work.nDevs; n++) {
+		SNAP_DEV *dev = &work.dev[n];
+
+		/* pattern matched a device that doesn't exist */
+		if (dev->fromPat && dev->openErr)
+			continue;
+		if (dev->openErr)
+			failed++;
+
+		printf("%s\n {\"device\":", first ? "" : ",");
+		first = 0;
+		JsonStr(dev->name);
+		printf(",\"time\":%llu,\"duration\":%u,",
+			(unsigned long long)dev->time, dev->duration);
+
+		if (dev->openErr) {
+			printf("\"open\":");
+			JsonErr(dev->openErr);
+			printf("}");
+			continue;
+		}
+
+		printf("\"codes\":{");
+		for (i = 0; i < WDOG_CODES; i++) {
+			printf("%s\"%s\":", i ? "," : "", G_wdogCode[i].name);
+			if (dev->val[i].err)
+				JsonErr(dev->val[i].err);
+			else
+				printf("%d", dev->val[i].val);
+		}
+		printf("}}");
+	}
+	printf("\n]%s}\n", truncated ? ",\"truncated\":true" : "");
+
+	free(tid);
+	free(work.dev);
+	return (failed || first || truncated) ? ERR_FUNC : ERR_OK;
+}
+
+#else /* !LINUX */
+
+/***************************************************************************/
+/** Read status of all devices in parallel - not supported
+ *
+ *  \return           ERR_PARAM
+ */
+int Snapshot(int argc, char *argv[], int nThreads)
+{
+	printf("*** -S not supported on this system\n");
+	return ERR_PARAM;
+}
+
+#endif /* LINUX */
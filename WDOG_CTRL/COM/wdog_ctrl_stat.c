@@ -0,0 +1,183 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                  WDOG_CTRL_STAT                    ************
+ ************                                                    ************
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*!
+ *        \file  wdog_ctrl_stat.c
+ *      \author  dieter.pfeuffer@men.de
+ *
+ *       \brief  Time distribution statistics for WDOG_CTRL
+ *
+ *               Values [us] are counted in a log-linear histogram:
+ *               values below 64 exactly, above in 32 buckets per
+ *               power of two (max. 3% error). This needs no memory per
+ *               sample, so it can run for any number of passes.
+ *
+ *    \switches  (none)
+ */
+ /*
+ *---------------------------------------------------------------------------
+ * Copyright 2016-2026, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+/*--------------------------------------+
+|  INCLUDES                             |
++--------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include "wdog_ctrl_int.h"
+
+/***************************************************************************/
+/** Get histogram bucket of value
+ *
+ *  \param val        \IN  value
+ *
+ *  \return           bucket index
+ */
+static u_int32 StatBucket(u_int32 val)
+{
+	u_int32 exp = 31;
+
+	if (val < 64)
+		return val;
+
+	while (!(val & (1UL << exp)))
+		exp--;
+
+	/* exp >= 6: 32 sub buckets from bits exp-1..exp-5 */
+	return 64 + (exp - 6) * 32 + ((val >> (exp - 5)) & 31);
+}
+
+/***************************************************************************/
+/** Get upper limit of histogram bucket
+ *
+ *  \param idx        \IN  bucket index
+ *
+ *  \return           largest value counted in bucket
+ */
+static u_int32 StatBucketMax(u_int32 idx)
+{
+	u_int32 exp, sub;
+
+	if (idx < 64)
+		return idx;
+
+	exp = (idx - 64) / 32 + 6;
+	sub = (idx - 64) % 32;
+	return (u_int32)((((u_int64)(32 + sub + 1)) << (exp - 5)) - 1);
+}
+
+/***************************************************************************/
+/** Reset statistics
+ *
+ *  \param st         \OUT statistics
+ */
+void StatInit(WDOG_STAT *st)
+{
+	memset(st, 0, sizeof(*st));
+}
+
+/***************************************************************************/
+/** Add value
+ *
+ *  \param st         \INOUT statistics
+ *  \param val        \IN  value [us]
+ */
+void StatAdd(WDOG_STAT *st, u_int32 val)
+{
+	if (!st->count || val < st->min)
+		st->min = val;
+	if (val > st->max)
+		st->max = val;
+	st->count++;
+	st->sum += val;
+	st->sumSq += (double)val * val;
+	st->hist[StatBucket(val)]++;
+}
+
+/***************************************************************************/
+/** Get percentile
+ *
+ *  \param st         \IN  statistics
+ *  \param pct        \IN  percentile [1/100 %] (e.g. 9999 for p99.99)
+ *
+ *  \return           upper limit of the bucket containing the percentile,
+ *                    limited to the max. value seen
+ */
+u_int32 StatPct(const WDOG_STAT *st, u_int32 pct)
+{
+	u_int64 rank, sum = 0;
+	u_int32 i;
+
+	if (!st->count)
+		return 0;
+
+	rank = ((u_int64)st->count * pct + 9999) / 10000;
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < STAT_BUCKETS; i++) {
+		sum += st->hist[i];
+		if (sum >= rank)
+			return StatBucketMax(i) < st->max ? StatBucketMax(i) : st->max;
+	}
+	return st->max;
+}
+
+/***************************************************************************/
+/** Square root (Newton), avoids linking the math library
+ *
+ *  \param x          \IN  value >= 0
+ *
+ *  \return           square root of x
+ */
+static double StatSqrt(double x)
+{
+	double r = x > 1 ? x : 1;
+	int i;
+
+	for (i = 0; i < 64; i++)
+		r = (r + x / r) / 2;
+	return r;
+}
+
+/***************************************************************************/
+/** Print statistics in one line
+ *
+ *  \param name       \IN  name of the value
+ *  \param st         \IN  statistics
+ */
+void StatPrint(const char *name, const WDOG_STAT *st)
+{
+	double mean, var;
+
+	if (!st->count) {
+		printf("%-22s: no values\n", name);
+		return;
+	}
+
+	mean = (double)st->sum / st->count;
+	var = st->sumSq / st->count - mean * mean;
+
+	printf("%-22s: n=%u min=%u mean=%.1f sdev=%.1f p50=%u p99=%u p99.99=%u max=%u [us]\n",
+		name, st->count, st->min, mean, var > 0 ? StatSqrt(var) : 0.0,
+		StatPct(st, 5000), StatPct(st, 9900), StatPct(st, 9999), st->max);
+}
@@ -0,0 +1,46 @@
+#***************************  M a k e f i l e  *******************************
+#
+#         Author: ds
+#
+#    Description: Makefile definitions for the minimal footprint WDOG
+#                 trigger program (no stdio, no heap)
+#
+#                 WDOG_MIN_PERIOD: default trigger period [ms]
+#                 WDOG_MIN_MSG=0 : no messages on the error path
+#                                  (messages need Linux write(), default 1)
+#
+#-----------------------------------------------------------------------------
+#   Copyright 1999-2026, MEN Mikro Elektronik GmbH
+#*****************************************************************************
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+MAK_NAME=wdog_simp_min
+# the next line is updated during the MDIS installation
+STAMPED_REVISION="mdis_tools_wdog_02_11-0-g50b52f9-dirty_2019-02-21"
+
+DEF_REVISION=MAK_REVISION=$(STAMPED_REVISION)
+MAK_SWITCH=$(SW_PREFIX)$(DEF_REVISION) \
+           $(SW_PREFIX)WDOG_MIN_PERIOD=100
+
+MAK_LIBS=$(LIB_PREFIX)$(MEN_LIB_DIR)/mdis_api$(LIB_SUFFIX)	\
+         $(LIB_PREFIX)$(MEN_LIB_DIR)/usr_oss$(LIB_SUFFIX)	\
+
+MAK_INCL=$(MEN_INC_DIR)/wdog.h	\
+         $(MEN_INC_DIR)/men_typs.h	\
+         $(MEN_INC_DIR)/mdis_api.h	\
+         $(MEN_INC_DIR)/usr_oss.h	\
+
+MAK_INP1=wdog_simp_min$(INP_SUFFIX)
+
+MAK_INP=$(MAK_INP1)
@@ -0,0 +1,232 @@
+/****************************************************************************
+ ************                                                    ************
+ ************                 WDOG_SIMP_MIN                      ************
+ ************                                                    ************
+ ****************************************************************************
+ *
+ *       Author: ds
+ *
+ *  Description: Minimal footprint trigger program for Watchdog drivers.
+ *
+ *               Same as wdog_simp, but for small targets: no stdio, no
+ *               heap, all state in one static structure, no output per
+ *               pass. External references are only MDIS API (M_open,
+ *               M_setstat, M_close), UOS_Delay/UOS_ErrnoGet and on Linux
+ *               mlockall() and write(). Messages are only written on the
+ *               error path with a raw write() to stderr, errors as hex
+ *               code (Linux only, switch WDOG_MIN_MSG=0 disables them).
+ *
+ *               Start Watchdog and trigger Watchdog forever,
+ *               !!! TERMINATION OF THE PROGRAM WILL RESET THE SYSTEM !!!.
+ *
+ *               The period is WDOG_MIN_PERIOD [ms] or the optional second
+ *               argument. On Linux all pages are locked into RAM with
+ *               mlockall() before the watchdog is started.
+ *
+ *     Required: libraries: mdis_api, usr_oss
+ *     Switches: LINUX, WDOG_MIN_PERIOD, WDOG_MIN_MSG
+ *
+ *
+ *---------------------------------------------------------------------------
+ * Copyright 1999-2026, MEN Mikro Elektronik GmbH
+ ******************************************************************************/
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <MEN/men_typs.h>
+#include <MEN/mdis_api.h>
+#include <MEN/usr_oss.h>
+#include <MEN/wdog.h>
+#ifdef LINUX
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+
+/*--------------------------------------+
+|   DEFINES                             |
++--------------------------------------*/
+#ifndef WDOG_MIN_PERIOD
+#	define WDOG_MIN_PERIOD	100		/* default trigger period [ms] */
+#endif
+
+#ifdef LINUX
+#	ifndef WDOG_MIN_MSG
+#		define WDOG_MIN_MSG	1		/* WDOG_MIN_MSG=0: no messages */
+#	endif
+#else
+#	undef WDOG_MIN_MSG				/* needs write() */
+#	define WDOG_MIN_MSG	0
+#endif
+
+/*--------------------------------------+
+|   TYPDEFS                             |
++--------------------------------------*/
+/* complete program state, preallocated */
+typedef struct {
+	MDIS_PATH	path;
+	int32		period;		/* trigger period [ms] */
+} WDOG_MIN_STATE;
+
+/*--------------------------------------+
+|   GLOBALS                             |
++--------------------------------------*/
+static WDOG_MIN_STATE G_st;
+
+/*--------------------------------------+
+|   PROTOTYPES                          |
++--------------------------------------*/
+static void Msg(const char *s1, const char *s2);
+static void MsgErr(const char *s);
+static int32 ParseMs(const char *s);
+
+
+/********************************* main *************************************
+ *
+ *  Description: Program main function
+ *
+ *---------------------------------------------------------------------------
+ *  Input......: argc,argv	argument counter, data ..
+ *  Output.....: return	    error (1), trigger loop doesn't return
+ *  Globals....: G_st
+ ****************************************************************************/
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		Msg("Syntax: wdog_simp_min <device> [<period ms>]", "");
+		return(1);
+	}
+
+	G_st.period = WDOG_MIN_PERIOD;
+	if ((argc > 2) && ((G_st.period = ParseMs(argv[2])) <= 0)) {
+		Msg("*** illegal period: ", argv[2]);
+		return(1);
+	}
+
+#ifdef LINUX
+	/* no page faults in the trigger loop */
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		Msg("*** can't lock memory", "");
+#endif
+
+	/*--------------------+
+    |  open path          |
+    +--------------------*/
+	if ((G_st.path = M_open(argv[1])) < 0) {
+		MsgErr("*** can't open: error ");
+		return(1);
+	}
+
+	/*--------------------+
+    |  start watchdog     |
+    +--------------------*/
+	if ((M_setstat(G_st.path, WDOG_START, 0)) < 0) {
+		MsgErr("*** can't setstat WDOG_START: error ");
+		goto abort;
+	}
+
+	/*--------------------+
+    |  trigger watchdog   |
+    +--------------------*/
+	for (;;) {
+		UOS_Delay(G_st.period);
+		if ((M_setstat(G_st.path, WDOG_TRIG, 0)) < 0) {
+			MsgErr("*** can't setstat WDOG_TRIG: error ");
+			break;
+		}
+	}
+
+	/*--------------------+
+    |  cleanup            |
+    +--------------------*/
+	abort:
+	M_close(G_st.path);
+	return(1);
+}
+
+/********************************* ParseMs **********************************
+ *
+ *  Description: Convert decimal string to period
+ *
+ *---------------------------------------------------------------------------
+ *  Input......: s		string
+ *  Output.....: return	period [ms] or -1 on error
+ *  Globals....: -
+ ****************************************************************************/
+static int32 ParseMs(const char *s)
+{
+	int32 val = 0;
+
+	if (!*s)
+		return(-1);
+	for (; *s; s++) {
+		if ((*s < '0') || (*s > '9') || (val > 100000000))
+			return(-1);
+		val = val * 10 + (*s - '0');
+	}
+	return(val);
+}
+
+/********************************* Msg **************************************
+ *
+ *  Description: Write message to stderr with a raw write
+ *
+ *---------------------------------------------------------------------------
+ *  Input......: s1		first part
+ *               s2		second part
+ *  Output.....: -
+ *  Globals....: -
+ ****************************************************************************/
+static void Msg(const char *s1, const char *s2)
+{
+#if WDOG_MIN_MSG
+	const char *s;
+	ssize_t n;
+
+	for (s = s1; *s; s++)
+		;
+	n = write(2, s1, s - s1);
+	for (s = s2; *s; s++)
+		;
+	n = write(2, s2, s - s2);
+	n = write(2, "\n", 1);
+	(void)n;
+#else
+	(void)s1;
+	(void)s2;
+#endif
+}
+
+/********************************* MsgErr ***********************************
+ *
+ *  Description: Write message with last error code (hex, no M_errstring)
+ *
+ *---------------------------------------------------------------------------
+ *  Input......: s		message
+ *  Output.....: -
+ *  Globals....: -
+ ****************************************************************************/
+static void MsgErr(const char *s)
+{
+	char hex[11];
+	u_int32 err = (u_int32)UOS_ErrnoGet();
+	int i;
+
+	hex[0] = '0';
+	hex[1] = 'x';
+	for (i = 9; i > 1; i--, err >>= 4)
+		hex[i] = "0123456789abcdef"[err & 0xf];
+	hex[10] = '\0';
+	Msg(s, hex);
+}